@@ -0,0 +1,19 @@
+# Writes the sources of all shaders and OpenCL kernels into a header as string constants.
+# Usage: cmake -DSOURCE_DIR=<shaders dir> -DOUTPUT=<header> -P embed_shaders.cmake
+
+file(GLOB SHADERS RELATIVE ${SOURCE_DIR} ${SOURCE_DIR}/*.vert ${SOURCE_DIR}/*.frag ${SOURCE_DIR}/*.cl)
+list(SORT SHADERS)
+
+set(CONTENT "#pragma once\n\n/* generated from ${SOURCE_DIR} by embed_shaders.cmake, do not edit */\n\n")
+set(CONTENT "${CONTENT}#include <map>\n#include <string>\n\nnamespace shaders {\n")
+set(CONTENT "${CONTENT}static const std::map<std::string, std::string> sources = {\n")
+foreach(SHADER ${SHADERS})
+	file(READ ${SOURCE_DIR}/${SHADER} TEXT)
+	set(CONTENT "${CONTENT}\t{\"${SHADER}\", R\"glsl(${TEXT})glsl\"},\n")
+endforeach()
+set(CONTENT "${CONTENT}};\n}\n")
+
+# rewrite only on change, so that dependent sources are not rebuilt needlessly
+file(WRITE ${OUTPUT}.tmp "${CONTENT}")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${OUTPUT}.tmp ${OUTPUT})
+file(REMOVE ${OUTPUT}.tmp)
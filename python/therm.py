@@ -0,0 +1,125 @@
+"""ctypes binding of libtherm, fields are numpy views of the mapped buffer."""
+
+import ctypes
+import ctypes.util
+import os
+
+import numpy as np
+
+GL, OPENCL, AMR, HYBRID, OOC, PARAREAL = range(6)
+EULER, RKL2 = range(2)
+
+
+class Config(ctypes.Structure):
+    _fields_ = [
+        ("backend", ctypes.c_int),
+        ("integrator", ctypes.c_int),
+        ("dt", ctypes.c_double),
+        ("size", ctypes.c_int),
+        ("cl_device", ctypes.c_int),
+        ("amr_tol", ctypes.c_float),
+        ("amr_every", ctypes.c_int),
+    ]
+
+
+class Field(ctypes.Structure):
+    _fields_ = [
+        ("temperature", ctypes.POINTER(ctypes.c_float)),
+        ("conductivity", ctypes.POINTER(ctypes.c_float)),
+        ("width", ctypes.c_int),
+        ("height", ctypes.c_int),
+        ("stride_x", ctypes.c_ssize_t),
+        ("stride_y", ctypes.c_ssize_t),
+    ]
+
+
+class Source(ctypes.Structure):
+    _fields_ = [
+        ("x", ctypes.c_float),
+        ("y", ctypes.c_float),
+        ("radius", ctypes.c_float),
+        ("power", ctypes.c_float),
+    ]
+
+
+def _load():
+    path = os.environ.get("THERM_LIBRARY") or ctypes.util.find_library("therm") or "libtherm.so"
+    lib = ctypes.CDLL(path)
+    lib.therm_error.restype = ctypes.c_char_p
+    lib.therm_config_default.argtypes = [ctypes.POINTER(Config)]
+    lib.therm_create.restype = ctypes.c_void_p
+    lib.therm_create.argtypes = [ctypes.POINTER(Config)]
+    lib.therm_destroy.argtypes = [ctypes.c_void_p]
+    lib.therm_steps.restype = ctypes.c_long
+    lib.therm_steps.argtypes = [ctypes.c_void_p]
+    lib.therm_step.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.therm_map_field.argtypes = [ctypes.c_void_p, ctypes.POINTER(Field)]
+    lib.therm_unmap_field.argtypes = [ctypes.c_void_p]
+    lib.therm_set_region.argtypes = [ctypes.c_void_p] + [ctypes.c_int]*4 + [ctypes.c_float]*2
+    lib.therm_set_sources.argtypes = [ctypes.c_void_p, ctypes.POINTER(Source), ctypes.c_int]
+    return lib
+
+
+_lib = _load()
+
+
+def _check(status):
+    if status != 0:
+        raise RuntimeError(_lib.therm_error().decode())
+
+
+def _view(ptr, field, owner):
+    """Array over the strided floats at ptr, without copying."""
+    size = (field.height - 1)*field.stride_y + (field.width - 1)*field.stride_x + 4
+    buf = (ctypes.c_char*size).from_address(ctypes.addressof(ptr.contents))
+    # the array keeps buf alive, buf keeps the simulation alive
+    buf.owner = owner
+    arr = np.ndarray(
+        (field.height, field.width), np.float32, buf,
+        strides=(field.stride_y, field.stride_x)
+    )
+    arr.flags.writeable = False
+    return arr
+
+
+class Simulation:
+    """All calls must come from the thread creating the first simulation."""
+
+    def __init__(self, **settings):
+        config = Config()
+        _lib.therm_config_default(ctypes.byref(config))
+        for name, value in settings.items():
+            setattr(config, name, value)
+        self._sim = _lib.therm_create(ctypes.byref(config))
+        if not self._sim:
+            raise RuntimeError(_lib.therm_error().decode())
+
+    def close(self):
+        if self._sim:
+            _lib.therm_destroy(self._sim)
+            self._sim = None
+
+    def __del__(self):
+        self.close()
+
+    @property
+    def steps(self):
+        return _lib.therm_steps(self._sim)
+
+    def step(self, n=1):
+        _check(_lib.therm_step(self._sim, n))
+
+    def field(self):
+        """Temperature and conductivity arrays, valid until the next call changing the simulation."""
+        f = Field()
+        _check(_lib.therm_map_field(self._sim, ctypes.byref(f)))
+        return _view(f.temperature, f, self), _view(f.conductivity, f, self)
+
+    def set_region(self, x, y, w, h, temperature=-1.0, conductivity=-1.0):
+        _check(_lib.therm_set_region(self._sim, x, y, w, h, temperature, conductivity))
+
+    def set_sources(self, sources):
+        """Heat sources as rows of x, y, radius, power, e.g. an (n, 4) array."""
+        data = np.ascontiguousarray(sources, np.float32).reshape(-1, 4)
+        ptr = data.ctypes.data_as(ctypes.POINTER(Source))
+        _check(_lib.therm_set_sources(self._sim, ptr, len(data)))
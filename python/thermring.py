@@ -0,0 +1,63 @@
+"""Reader of the shared-memory snapshot ring of thermring.h, published with --shm."""
+
+import mmap
+import struct
+
+import numpy as np
+
+_HEADER = struct.Struct("=8s6IQ")
+_SLOT = struct.Struct("=QQ4I")
+_LATEST = _HEADER.size - 8
+_SLOT_HEADER = 64
+VERSION = 1
+
+
+class Frame:
+    """Temperature of a slot, used in place until the ring laps it."""
+
+    def __init__(self, ring, offset, seq):
+        _, self.step, width, height, stride, self.factor = _SLOT.unpack_from(ring._map, offset)
+        self._ring = ring
+        self._offset = offset
+        self._seq = seq
+        rows = np.frombuffer(ring._map, np.float32, height*stride, offset + _SLOT_HEADER)
+        self.data = rows.reshape(height, stride)[:, :width]
+
+    def valid(self):
+        """True if nothing read from data so far was overwritten meanwhile."""
+        return self._ring._u64(self._offset) == self._seq
+
+
+class Ring:
+    """Aligned 8 byte loads are atomic on the hosts the publisher runs on."""
+
+    def __init__(self, name):
+        with open("/dev/shm/" + name.lstrip("/"), "rb") as f:
+            self._map = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+        head = _HEADER.unpack_from(self._map, 0)
+        if head[0] != b"THRMRING" or head[1] != VERSION:
+            raise ValueError("not a therm ring of version %d" % VERSION)
+        _, _, self.header_size, self.slot_count, self.slot_size, self.max_width, self.max_height, _ = head
+
+    def _u64(self, offset):
+        return struct.unpack_from("=Q", self._map, offset)[0]
+
+    def view(self):
+        """Newest complete frame without copying, None if there is none yet."""
+        while True:
+            n = self._u64(_LATEST)
+            if n == 0:
+                return None
+            offset = self.header_size + (n - 1) % self.slot_count*self.slot_size
+            if self._u64(offset) == 2*n:
+                return Frame(self, offset, 2*n)
+
+    def read(self):
+        """Step and a copy of the newest frame, None if there is none yet."""
+        while True:
+            frame = self.view()
+            if frame is None:
+                return None
+            data = frame.data.copy()
+            if frame.valid():
+                return frame.step, data
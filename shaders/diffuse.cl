@@ -0,0 +1,40 @@
+/* The operators of diffuse.frag and rkl2.frag on plain row-major arrays,
+ * cells outside the grid take the value of the nearest edge cell. */
+
+int cell(int2 size, int x, int y) {
+	return clamp(y, 0, size.y - 1)*size.x + clamp(x, 0, size.x - 1);
+}
+
+float deriv(global const float *t, global const float *k, int2 size, int x, int y) {
+	float
+	  c = t[cell(size, x, y)],
+	  n = t[cell(size, x, y + 1)] + t[cell(size, x, y - 1)] +
+	      t[cell(size, x + 1, y)] + t[cell(size, x - 1, y)];
+	return -k[cell(size, x, y)]*(4.0f*c - n);
+}
+
+kernel void diffuse(
+	global const float *src, global const float *cond, global float *dst,
+	int2 size, float dt
+) {
+	int x = get_global_id(0), y = get_global_id(1);
+	if(x >= size.x || y >= size.y)
+		return;
+	int i = y*size.x + x;
+	dst[i] = src[i] + dt*deriv(src, cond, size, x, y);
+}
+
+/* coef holds mu, nu, mu~, gamma~ of the stage */
+kernel void rkl2(
+	global const float *src, global const float *src_prev, global const float *initial,
+	global const float *cond, global float *dst,
+	int2 size, float dt, float4 coef
+) {
+	int x = get_global_id(0), y = get_global_id(1);
+	if(x >= size.x || y >= size.y)
+		return;
+	int i = y*size.x + x;
+	dst[i] =
+	  coef.x*src[i] + coef.y*src_prev[i] + (1.0f - coef.x - coef.y)*initial[i] +
+	  dt*(coef.z*deriv(src, cond, size, x, y) + coef.w*deriv(initial, cond, size, x, y));
+}
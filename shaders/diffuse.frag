@@ -1,5 +1,6 @@
 uniform sampler2D u_source;
 uniform ivec2 u_area_size;
+uniform float u_dt;
 
 varying vec2 v_uni_coord;
 
@@ -21,6 +22,5 @@ void main(void) {
 	  r = texture2D(u_source, pix_to_uni(pix + ivec2(-1, 0)));
 	float div = 4.0*c.x - (t.x + b.x + l.x + r.x);
 	float deriv = c.y*div;
-	float dt = 1e-1;
-    gl_FragColor = c - vec4(deriv*dt, 0.0, 0.0, 0.0);
+    gl_FragColor = c - vec4(deriv*u_dt, 0.0, 0.0, 0.0);
 }
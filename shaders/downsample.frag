@@ -0,0 +1,40 @@
+uniform sampler2D u_source;
+uniform ivec2 u_area_size;
+uniform ivec2 u_target_size;
+uniform ivec2 u_factor;
+/* 0 - point, 1 - box average, 2 - minimum, 3 - maximum */
+uniform int u_mode;
+
+varying vec2 v_uni_coord;
+
+vec2 pix_to_uni(ivec2 pix) {
+	return (vec2(pix) + vec2(0.5, 0.5))/vec2(u_area_size);
+}
+
+void main(void) {
+	ivec2 base = ivec2(v_uni_coord*vec2(u_target_size))*u_factor;
+	vec4 v = texture2D(u_source, pix_to_uni(base));
+	if(u_mode != 0) {
+		vec4 sum = vec4(0.0), lo = v, hi = v;
+		int n = 0;
+		for(int iy = 0; iy < u_factor.y; ++iy) {
+			for(int ix = 0; ix < u_factor.x; ++ix) {
+				ivec2 pix = base + ivec2(ix, iy);
+				if(pix.x < u_area_size.x && pix.y < u_area_size.y) {
+					vec4 s = texture2D(u_source, pix_to_uni(pix));
+					sum += s;
+					lo = min(lo, s);
+					hi = max(hi, s);
+					n += 1;
+				}
+			}
+		}
+		if(u_mode == 1)
+			v = sum/float(n);
+		else if(u_mode == 2)
+			v = lo;
+		else
+			v = hi;
+	}
+	gl_FragColor = v;
+}
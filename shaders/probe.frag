@@ -0,0 +1,13 @@
+uniform sampler2D u_source;
+/* positions of the probes from 0 to 1 in x and y, a texel each */
+uniform sampler2D u_probes;
+uniform int u_count;
+
+varying vec2 v_uni_coord;
+
+/* a row of the target holds the temperature at every probe */
+void main(void) {
+	float i = floor(v_uni_coord.x*float(u_count));
+	vec2 pos = texture2D(u_probes, vec2((i + 0.5)/float(u_count), 0.5)).xy;
+	gl_FragColor = vec4(texture2D(u_source, pos).x, 0.0, 0.0, 0.0);
+}
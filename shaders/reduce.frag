@@ -0,0 +1,31 @@
+uniform sampler2D u_source;
+uniform ivec2 u_area_size;
+uniform ivec2 u_target_size;
+/* the source is the field itself, not a previous reduction */
+uniform int u_first;
+
+varying vec2 v_uni_coord;
+
+const int FACTOR = 8;
+
+vec2 pix_to_uni(ivec2 pix) {
+	return (vec2(pix) + vec2(0.5, 0.5))/vec2(u_area_size);
+}
+
+/* reduces a block of the source to (sum, min, max) of temperature */
+void main(void) {
+	ivec2 base = ivec2(v_uni_coord*vec2(u_target_size))*FACTOR;
+	vec4 r = vec4(0.0, 1e30, -1e30, 0.0);
+	for(int iy = 0; iy < FACTOR; ++iy) {
+		for(int ix = 0; ix < FACTOR; ++ix) {
+			ivec2 pix = base + ivec2(ix, iy);
+			if(pix.x < u_area_size.x && pix.y < u_area_size.y) {
+				vec4 s = texture2D(u_source, pix_to_uni(pix));
+				if(u_first != 0)
+					s = vec4(s.x, s.x, s.x, 0.0);
+				r = vec4(r.x + s.x, min(r.y, s.y), max(r.z, s.z), 0.0);
+			}
+		}
+	}
+	gl_FragColor = r;
+}
@@ -0,0 +1,41 @@
+uniform sampler2D u_source;
+uniform sampler2D u_source_prev;
+uniform sampler2D u_initial;
+uniform ivec2 u_area_size;
+uniform float u_dt;
+/* stage coefficients: mu, nu, mu~, gamma~ */
+uniform vec4 u_coef;
+
+varying vec2 v_uni_coord;
+
+ivec2 uni_to_pix(vec2 uni) {
+	return ivec2(uni*vec2(u_area_size));
+}
+
+vec2 pix_to_uni(ivec2 pix) {
+	return (vec2(pix) + vec2(0.5, 0.5))/vec2(u_area_size);
+}
+
+/* the same operator the explicit Euler step of diffuse.frag applies */
+float deriv(sampler2D s, ivec2 pix) {
+	vec4 
+	  c = texture2D(s, pix_to_uni(pix)), 
+	  t = texture2D(s, pix_to_uni(pix + ivec2( 0, 1))), 
+	  b = texture2D(s, pix_to_uni(pix + ivec2( 0,-1))), 
+	  l = texture2D(s, pix_to_uni(pix + ivec2( 1, 0))), 
+	  r = texture2D(s, pix_to_uni(pix + ivec2(-1, 0)));
+	return -c.y*(4.0*c.x - (t.x + b.x + l.x + r.x));
+}
+
+void main(void) {
+	ivec2 pix = uni_to_pix(v_uni_coord);
+	vec2 uni = pix_to_uni(pix);
+	vec4 y0 = texture2D(u_initial, uni);
+	float 
+	  y1 = texture2D(u_source, uni).x, 
+	  y2 = texture2D(u_source_prev, uni).x;
+	float y = 
+	  u_coef.x*y1 + u_coef.y*y2 + (1.0 - u_coef.x - u_coef.y)*y0.x + 
+	  u_dt*(u_coef.z*deriv(u_source, pix) + u_coef.w*deriv(u_initial, pix));
+	gl_FragColor = vec4(y, y0.yzw);
+}
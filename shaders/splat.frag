@@ -0,0 +1,15 @@
+uniform float u_dt;
+
+varying vec2 v_offset;
+varying float v_radius;
+varying float v_power;
+
+void main(void) {
+	/* a point source heats the one cell it lies in */
+	bool inside = v_radius <= 0.5 ?
+	  all(lessThan(abs(v_offset), vec2(0.5))) :
+	  length(v_offset) <= v_radius;
+	if(!inside)
+		discard;
+	gl_FragColor = vec4(v_power*u_dt, 0.0, 0.0, 0.0);
+}
@@ -0,0 +1,20 @@
+attribute vec2 a_vertex;
+/* x and y from 0 to 1, radius in cells, temperature added per unit of time */
+attribute vec4 a_source;
+uniform ivec2 u_area_size;
+
+varying vec2 v_offset;
+varying float v_radius;
+varying float v_power;
+
+void main() {
+	vec2 cells = vec2(u_area_size);
+	vec2 center = a_source.xy*cells;
+	/* covers every cell whose center may be inside */
+	float half_size = max(a_source.z, 0.5) + 0.5;
+	vec2 corner = center + (2.0*a_vertex - 1.0)*half_size;
+	gl_Position = vec4(2.0*corner/cells - 1.0, 0.0, 1.0);
+	v_offset = corner - center;
+	v_radius = a_source.z;
+	v_power = a_source.w;
+}
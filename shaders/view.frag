@@ -0,0 +1,9 @@
+uniform sampler2D u_texture;
+/* origin and extent of the visible part in texture coordinates */
+uniform vec4 u_rect;
+
+varying vec2 v_uni_coord;
+
+void main() {
+	gl_FragColor = texture2D(u_texture, u_rect.xy + v_uni_coord*u_rect.zw);
+}
@@ -0,0 +1,664 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <limits>
+
+#include "solver.hpp"
+#include "hostview.hpp"
+
+/* Heat diffusion on a quadtree of fixed-size blocks, refined where the
+ * temperature changes quickly or the conductivity jumps and coarsened
+ * elsewhere, so memory and work follow the features of the field instead
+ * of its extent. Blocks live in an atlas of equally sized slots reused
+ * on refinement and coarsening. Neighbouring leaves differ by at most
+ * one level, and the flux across each coarse-fine face is computed once
+ * and applied to both sides, so no heat is lost at the interfaces.
+ *
+ * Grid sizes are the effective resolution of the finest level and must
+ * be the block size times a power of two. */
+class AMRSolver : public Solver {
+private:
+	/* cells along each side of a block */
+	static const int B = 16;
+	/* len/dist of a face between a cell and one of its two finer neighbours */
+	static constexpr float W_CF = 2.0f/3;
+	
+	enum Dir {
+		LEFT,
+		RIGHT,
+		DOWN,
+		UP
+	};
+	
+	enum EdgeKind {
+		BOUNDARY,
+		SAME,
+		COARSER,
+		FINER
+	};
+	
+	/* neighbourhood of a leaf across one of its edges */
+	struct Edge {
+		EdgeKind kind;
+		/* FINER has two blocks, in order along the edge */
+		int slot[2];
+		/* COARSER: first cell of the coarse edge touching this block */
+		int offset;
+	};
+	
+	struct Block {
+		int level = -1;
+		int bx = 0, by = 0;
+		Edge edges[4];
+	};
+	
+	/* grid size and the level of blocks with unit cells */
+	int size = 0;
+	int max_level = 0;
+	
+	float tol;
+	int adapt_every;
+	long steps_done = 0;
+	
+	/* atlas of B*B cells per slot, t[0] holds the current temperature */
+	std::vector<float> t[4];
+	std::vector<float> cond;
+	/* derivative of the initial value of an RKL2 step and scratch */
+	std::vector<float> d0, d1;
+	std::vector<Block> blocks;
+	std::vector<int> free_slots;
+	/* slots of all leaves */
+	std::vector<int> leaves;
+	/* slot of a leaf, or INTERNAL for refined nodes */
+	std::unordered_map<uint64_t, int> nodes;
+	static const int INTERNAL = -1;
+	
+	/* temperature and conductivity of the finest cells, for refinement */
+	std::function<void(int, int, float &, float &)> source;
+	
+	HostView view;
+	Field2D host;
+	
+	static uint64_t key(int level, int bx, int by) {
+		return (uint64_t(level) << 58) | (uint64_t(bx) << 29) | uint64_t(by);
+	}
+	int find(int level, int bx, int by) const {
+		auto iter = nodes.find(key(level, bx, by));
+		return iter == nodes.end() ? -2 : iter->second;
+	}
+	
+	/* cell size in units of the finest cells */
+	double cellSize(int level) const {
+		return double(size)/(B << level);
+	}
+	
+	int allocSlot() {
+		if(!free_slots.empty()) {
+			int s = free_slots.back();
+			free_slots.pop_back();
+			return s;
+		}
+		int s = blocks.size();
+		blocks.push_back(Block());
+		for(std::vector<float> &v : t) {
+			v.resize(B*B*blocks.size());
+		}
+		cond.resize(B*B*blocks.size());
+		d0.resize(B*B*blocks.size());
+		d1.resize(B*B*blocks.size());
+		return s;
+	}
+	void freeSlot(int s) {
+		blocks[s].level = -1;
+		free_slots.push_back(s);
+	}
+	
+	/* samples the source at the finest cell nearest to the cell center */
+	void fillFromSource(int s, int i, int j) {
+		const Block &b = blocks[s];
+		double h = cellSize(b.level);
+		int x = std::min(int((b.bx*B + i + 0.5)*h), size - 1);
+		int y = std::min(int((b.by*B + j + 0.5)*h), size - 1);
+		source(x, y, t[0][s*B*B + j*B + i], cond[s*B*B + j*B + i]);
+	}
+	
+	int newLeaf(int level, int bx, int by) {
+		int s = allocSlot();
+		blocks[s].level = level;
+		blocks[s].bx = bx;
+		blocks[s].by = by;
+		nodes[key(level, bx, by)] = s;
+		return s;
+	}
+	
+	/* coordinates of the neighbouring region at the same level, false at the domain boundary */
+	bool neighbour(int level, int bx, int by, int dir, int &nx, int &ny) const {
+		int n = 1 << level;
+		nx = bx + (dir == RIGHT) - (dir == LEFT);
+		ny = by + (dir == UP) - (dir == DOWN);
+		return nx >= 0 && ny >= 0 && nx < n && ny < n;
+	}
+	
+	/* splits a leaf into four, refining coarser neighbours first to keep the 2:1 balance;
+	 * cells are injected from the parent unless from_source is set, fixed cells always
+	 * come from the source */
+	void refine(int level, int bx, int by, bool from_source) {
+		int s = find(level, bx, by);
+		if(s < 0 || level >= max_level)
+			return;
+		for(int dir = 0; dir < 4; ++dir) {
+			int nx, ny;
+			if(neighbour(level, bx, by, dir, nx, ny) && find(level, nx, ny) == -2)
+				refine(level - 1, nx >> 1, ny >> 1, from_source);
+		}
+		/* the parent slot is kept until the children are filled */
+		nodes[key(level, bx, by)] = INTERNAL;
+		for(int c = 0; c < 4; ++c) {
+			int cx = c & 1, cy = c >> 1;
+			int cs = newLeaf(level + 1, 2*bx + cx, 2*by + cy);
+			for(int j = 0; j < B; ++j) {
+				for(int i = 0; i < B; ++i) {
+					int ci = cs*B*B + j*B + i;
+					fillFromSource(cs, i, j);
+					if(!from_source && cond[ci] > 0.0f)
+						t[0][ci] = t[0][s*B*B + (cy*B/2 + j/2)*B + cx*B/2 + i/2];
+				}
+			}
+		}
+		freeSlot(s);
+	}
+	
+	/* merges four leaves into their parent if that keeps the 2:1 balance */
+	bool coarsen(int level, int bx, int by) {
+		int cs[4];
+		for(int c = 0; c < 4; ++c) {
+			int cx = 2*bx + (c & 1), cy = 2*by + (c >> 1);
+			cs[c] = find(level + 1, cx, cy);
+			if(cs[c] < 0)
+				return false;
+			for(int dir = 0; dir < 4; ++dir) {
+				int nx, ny;
+				if(neighbour(level + 1, cx, cy, dir, nx, ny) && find(level + 1, nx, ny) == INTERNAL)
+					return false;
+			}
+		}
+		int s = newLeaf(level, bx, by);
+		for(int j = 0; j < B; ++j) {
+			for(int i = 0; i < B; ++i) {
+				int ci = s*B*B + j*B + i;
+				fillFromSource(s, i, j);
+				if(cond[ci] <= 0.0f)
+					continue;
+				/* the average keeps the heat of the four cells */
+				int c = (j >= B/2)*2 + (i >= B/2);
+				int base = cs[c]*B*B + (2*j % B)*B + 2*i % B;
+				t[0][ci] = 0.25f*(t[0][base] + t[0][base + 1] + t[0][base + B] + t[0][base + B + 1]);
+			}
+		}
+		for(int c = 0; c < 4; ++c) {
+			nodes.erase(key(level + 1, 2*bx + (c & 1), 2*by + (c >> 1)));
+			freeSlot(cs[c]);
+		}
+		return true;
+	}
+	
+	/* value of the cell across an edge, weighted sum of len/dist*(neighbour - cell) */
+	float edgeFlux(const std::vector<float> &y, const Block &b, int s, int dir, int i, int j) const {
+		const Edge &e = b.edges[dir];
+		int along = dir == LEFT || dir == RIGHT ? j : i;
+		float c = y[s*B*B + j*B + i];
+		/* cell of the neighbouring block adjacent to the edge at position p along it */
+		auto cell = [dir](int p) -> int {
+			switch(dir) {
+			case LEFT:
+				return p*B + B - 1;
+			case RIGHT:
+				return p*B;
+			case DOWN:
+				return (B - 1)*B + p;
+			default:
+				return p;
+			}
+		};
+		switch(e.kind) {
+		case SAME:
+			return y[e.slot[0]*B*B + cell(along)] - c;
+		case COARSER:
+			return W_CF*(y[e.slot[0]*B*B + cell(e.offset + along/2)] - c);
+		case FINER: {
+			int f = 2*along;
+			const float *fb = &y[e.slot[f/B]*B*B];
+			return W_CF*(fb[cell(f % B)] - c) + W_CF*(fb[cell(f % B + 1)] - c);
+		}
+		default:
+			return 0.0f;
+		}
+	}
+	
+	/* largest temperature step between neighbouring cells of a leaf, including
+	 * those across its edges, where the cells are not both fixed; infinite
+	 * where the conductivity jumps. The edges must be up to date. */
+	float indicator(int s) const {
+		const Block &b = blocks[s];
+		const float *tb = &t[0][s*B*B], *kb = &cond[s*B*B];
+		float m = 0.0f;
+		for(int j = 0; j < B; ++j) {
+			for(int i = 0; i < B; ++i) {
+				int c = j*B + i;
+				int nb[2] = {i + 1 < B ? c + 1 : -1, j + 1 < B ? c + B : -1};
+				for(int n : nb) {
+					if(n < 0 || (kb[c] <= 0.0f && kb[n] <= 0.0f))
+						continue;
+					if(kb[c] != kb[n])
+						return std::numeric_limits<float>::infinity();
+					m = std::max(m, std::fabs(tb[c] - tb[n]));
+				}
+				if(i > 0 && i < B - 1 && j > 0 && j < B - 1)
+					continue;
+				int dirs[4] = {i == 0 ? LEFT : -1, i == B - 1 ? RIGHT : -1, j == 0 ? DOWN : -1, j == B - 1 ? UP : -1};
+				for(int dir : dirs) {
+					if(dir < 0)
+						continue;
+					if(edgeFlux(cond, b, s, dir, i, j) != 0.0f)
+						return std::numeric_limits<float>::infinity();
+					if(kb[c] > 0.0f)
+						m = std::max(m, std::fabs(edgeFlux(t[0], b, s, dir, i, j)));
+				}
+			}
+		}
+		return m;
+	}
+	
+	void rebuildLeaves() {
+		leaves.clear();
+		for(int s = 0; s < int(blocks.size()); ++s) {
+			Block &b = blocks[s];
+			if(b.level < 0)
+				continue;
+			leaves.push_back(s);
+			for(int dir = 0; dir < 4; ++dir) {
+				Edge &e = b.edges[dir];
+				int nx, ny;
+				if(!neighbour(b.level, b.bx, b.by, dir, nx, ny)) {
+					e.kind = BOUNDARY;
+					continue;
+				}
+				int n = find(b.level, nx, ny);
+				if(n >= 0) {
+					e.kind = SAME;
+					e.slot[0] = n;
+				} else if(n == INTERNAL) {
+					/* the two children of the neighbour facing this block */
+					e.kind = FINER;
+					for(int k = 0; k < 2; ++k) {
+						int cx = 2*nx, cy = 2*ny;
+						if(dir == LEFT || dir == RIGHT) {
+							cx += dir == LEFT;
+							cy += k;
+						} else {
+							cx += k;
+							cy += dir == DOWN;
+						}
+						e.slot[k] = find(b.level + 1, cx, cy);
+					}
+				} else {
+					e.kind = COARSER;
+					e.slot[0] = find(b.level - 1, nx >> 1, ny >> 1);
+					bool along_x = dir == DOWN || dir == UP;
+					e.offset = ((along_x ? b.bx : b.by) & 1)*B/2;
+				}
+			}
+		}
+	}
+	
+	/* refines and coarsens by the temperature gradients of the current field */
+	void adapt() {
+		/* by node, as refining reuses the slots of the leaves */
+		std::vector<std::pair<uint64_t, float>> ind;
+		for(int s : leaves) {
+			const Block &b = blocks[s];
+			ind.push_back(std::make_pair(key(b.level, b.bx, b.by), indicator(s)));
+		}
+		std::vector<uint64_t> refined;
+		for(const std::pair<uint64_t, float> &p : ind) {
+			int level = p.first >> 58;
+			if(p.second > tol && level < max_level)
+				refined.push_back(p.first);
+		}
+		for(uint64_t k : refined) {
+			int level = k >> 58, bx = (k >> 29) & ((1 << 29) - 1), by = k & ((1 << 29) - 1);
+			refine(level, bx, by, false);
+		}
+		/* parents of which all four children are leaves flat enough */
+		std::unordered_map<uint64_t, int> flat;
+		for(const std::pair<uint64_t, float> &p : ind) {
+			int level = p.first >> 58, bx = (p.first >> 29) & ((1 << 29) - 1), by = p.first & ((1 << 29) - 1);
+			if(p.second >= 0.25f*tol || level <= 0)
+				continue;
+			/* refined above */
+			if(find(level, bx, by) < 0)
+				continue;
+			flat[key(level - 1, bx >> 1, by >> 1)] += 1;
+		}
+		for(const std::pair<const uint64_t, int> &p : flat) {
+			if(p.second != 4)
+				continue;
+			int level = p.first >> 58, bx = (p.first >> 29) & ((1 << 29) - 1), by = p.first & ((1 << 29) - 1);
+			coarsen(level, bx, by);
+		}
+		rebuildLeaves();
+	}
+	
+	/* builds the tree from the source, refining down to the features */
+	void build() {
+		nodes.clear();
+		blocks.clear();
+		free_slots.clear();
+		int root = newLeaf(0, 0, 0);
+		for(int j = 0; j < B; ++j) {
+			for(int i = 0; i < B; ++i) {
+				fillFromSource(root, i, j);
+			}
+		}
+		/* a level per pass, so that the edges seen by the indicator are current */
+		for(bool refined = true; refined; ) {
+			rebuildLeaves();
+			std::vector<uint64_t> split;
+			for(int ls : leaves) {
+				const Block &b = blocks[ls];
+				if(b.level < max_level && indicator(ls) > tol)
+					split.push_back(key(b.level, b.bx, b.by));
+			}
+			for(uint64_t k : split) {
+				int level = k >> 58, bx = (k >> 29) & ((1 << 29) - 1), by = k & ((1 << 29) - 1);
+				refine(level, bx, by, true);
+			}
+			refined = !split.empty();
+		}
+		float k_max = 0.0f;
+		for(float k : cond) {
+			k_max = std::max(k_max, k);
+		}
+		setupIntegrator(k_max);
+		fprintf(stderr, "AMR: %d blocks of %dx%d for a %dx%d grid\n", int(leaves.size()), B, B, size, size);
+	}
+	
+	void setSize(int sx, int sy) {
+		int level = 0;
+		while((B << level) < sx)
+			++level;
+		if(sx != sy || (B << level) != sx)
+			throw std::runtime_error("AMR grid size must be square and 16 times a power of two");
+		size = sx;
+		max_level = level;
+	}
+	
+	/* time derivative of the temperature y on all leaves */
+	void derivative(const std::vector<float> &y, std::vector<float> &out) const {
+		for(int s : leaves) {
+			const Block &b = blocks[s];
+			double h = cellSize(b.level);
+			float inv_area = float(1.0/(h*h));
+			const float *yb = &y[s*B*B], *kb = &cond[s*B*B];
+			float *ob = &out[s*B*B];
+			for(int j = 0; j < B; ++j) {
+				for(int i = 0; i < B; ++i) {
+					int c = j*B + i;
+					if(kb[c] <= 0.0f) {
+						ob[c] = 0.0f;
+						continue;
+					}
+					float acc = 0.0f;
+					acc += i > 0     ? yb[c - 1] - yb[c] : edgeFlux(y, b, s, LEFT, i, j);
+					acc += i < B - 1 ? yb[c + 1] - yb[c] : edgeFlux(y, b, s, RIGHT, i, j);
+					acc += j > 0     ? yb[c - B] - yb[c] : edgeFlux(y, b, s, DOWN, i, j);
+					acc += j < B - 1 ? yb[c + B] - yb[c] : edgeFlux(y, b, s, UP, i, j);
+					ob[c] = kb[c]*inv_area*acc;
+				}
+			}
+		}
+	}
+	
+	void stepEuler() {
+		derivative(t[0], d0);
+		float fdt = float(dt);
+		for(int s : leaves) {
+			for(int c = s*B*B; c < (s + 1)*B*B; ++c) {
+				t[1][c] = t[0][c] + fdt*d0[c];
+			}
+		}
+		std::swap(t[0], t[1]);
+	}
+	
+	void stepRKL2() {
+		float fdt = float(dt);
+		derivative(t[0], d0);
+		int prev = 0, prev2 = 0, next = 1;
+		for(size_t i = 0; i < stages.size(); i += 4) {
+			const float *coef = &stages[i];
+			if(i > 0)
+				derivative(t[prev], d1);
+			const std::vector<float> &dy = i > 0 ? d1 : d0;
+			for(int s : leaves) {
+				for(int c = s*B*B; c < (s + 1)*B*B; ++c) {
+					t[next][c] =
+					  coef[0]*t[prev][c] + coef[1]*t[prev2][c] + (1.0f - coef[0] - coef[1])*t[0][c] +
+					  fdt*(coef[2]*dy[c] + coef[3]*d0[c]);
+				}
+			}
+			prev2 = prev;
+			prev = next;
+			next = next % 3 + 1;
+		}
+		std::swap(t[0], t[prev]);
+	}
+	
+	/* samples temperature and conductivity at the centers of a w*h grid over the domain */
+	void rasterize(int w, int h, Field2D &out) const {
+		out.resize(2, w, h);
+		double fx = double(size)/w, fy = double(size)/h;
+		for(int s : leaves) {
+			const Block &b = blocks[s];
+			double cs = cellSize(b.level);
+			double x0 = b.bx*B*cs, y0 = b.by*B*cs;
+			int px0 = std::max(0, int(std::ceil(x0/fx - 0.5))), px1 = std::min(w, int(std::ceil((x0 + B*cs)/fx - 0.5)));
+			int py0 = std::max(0, int(std::ceil(y0/fy - 0.5))), py1 = std::min(h, int(std::ceil((y0 + B*cs)/fy - 0.5)));
+			for(int py = py0; py < py1; ++py) {
+				int j = std::min(B - 1, int(((py + 0.5)*fy - y0)/cs));
+				float *ot = out.row(TEMP, py), *ok = out.row(COND, py);
+				for(int px = px0; px < px1; ++px) {
+					int i = std::min(B - 1, int(((px + 0.5)*fx - x0)/cs));
+					ot[px] = t[0][s*B*B + j*B + i];
+					ok[px] = cond[s*B*B + j*B + i];
+				}
+			}
+		}
+	}
+
+protected:
+	/* the state becomes the source, so it is kept at full size */
+	void load(const Field2D &state) override {
+		setSize(state.width(), state.height());
+		std::shared_ptr<const Field2D> cells = std::make_shared<const Field2D>(state);
+		source = [cells](int x, int y, float &tv, float &kv) {
+			tv = cells->at(TEMP, x, y);
+			kv = cells->at(COND, x, y);
+		};
+		build();
+	}
+
+public:
+	/* blocks are refined above tol temperature difference between neighbouring cells
+	 * and coarsened below tol/4, every adapt_steps steps */
+	AMRSolver(Integrator integ = EULER, double step_dt = 0.1, float refine_tol = 0.02f, int adapt_steps = 16)
+	  : Solver(integ, step_dt), tol(refine_tol), adapt_every(std::max(adapt_steps, 1)) {}
+	
+	/* builds from the analytic initial state, never holding a full grid */
+	void start(int sx, int sy) override {
+		setSize(sx, sy);
+		int n = size;
+		source = [n](int x, int y, float &tv, float &kv) {
+			initialCell(double(x)/n, double(y)/n, tv, kv);
+		};
+		build();
+	}
+	
+	const char *name() const override {
+		return "amr";
+	}
+	int width() const override {
+		return size;
+	}
+	int height() const override {
+		return size;
+	}
+	int blockCount() const {
+		return leaves.size();
+	}
+	
+	void step(int n) override {
+		for(int i = 0; i < n; ++i) {
+			switch(integrator) {
+			case EULER:
+				stepEuler();
+				break;
+			case RKL2:
+				stepRKL2();
+				break;
+			}
+			steps_done += 1;
+			if(steps_done % adapt_every == 0)
+				adapt();
+		}
+	}
+	
+	/* the level cap follows the grid size, the tree itself is kept */
+	void resize(int sx, int sy) override {
+		if(sx == size && sy == size)
+			return;
+		int old_size = size;
+		try {
+			setSize(sx, sy);
+		} catch(const std::runtime_error &e) {
+			fprintf(stderr, "%s\n", e.what());
+			return;
+		}
+		/* the source is given in cells of the old grid, merged blocks read it */
+		auto old = source;
+		int scale_num = old_size, scale_den = size;
+		source = [old, scale_num, scale_den](int x, int y, float &tv, float &kv) {
+			old(int(int64_t(x)*scale_num/scale_den), int(int64_t(y)*scale_num/scale_den), tv, kv);
+		};
+		bool merged = true;
+		while(merged) {
+			merged = false;
+			for(int s : std::vector<int>(leaves)) {
+				const Block &b = blocks[s];
+				if(b.level > max_level && find(b.level, b.bx, b.by) == s) {
+					merged |= coarsen(b.level - 1, b.bx >> 1, b.by >> 1);
+				}
+			}
+			rebuildLeaves();
+		}
+		float k_max = 0.0f;
+		for(float k : cond) {
+			k_max = std::max(k_max, k);
+		}
+		setupIntegrator(k_max);
+	}
+	
+	void readState(Field2D &state) override {
+		rasterize(size, size, state);
+	}
+	
+	/* point sampling reads only the cells it needs, the other modes
+	 * weigh every leaf cell by its overlap with the target cells */
+	void readField(Field2D &data, int factor, Reduction mode) override {
+		factor = std::max(factor, 1);
+		int w = (size + factor - 1)/factor;
+		int h = (size + factor - 1)/factor;
+		if(mode == POINT) {
+			Field2D state;
+			rasterize(w, h, state);
+			data.resize(1, w, h);
+			for(int py = 0; py < h; ++py) {
+				std::copy(state.row(TEMP, py), state.row(TEMP, py) + w, data.row(0, py));
+			}
+			return;
+		}
+		Field2D weight(1, w, h);
+		data.resize(1, w, h);
+		data.fill(0, mode == BOX ? 0.0f : mode == MIN ? 1e30f : -1e30f);
+		for(int s : leaves) {
+			const Block &b = blocks[s];
+			double cs = cellSize(b.level);
+			for(int j = 0; j < B; ++j) {
+				double cy0 = (b.by*B + j)*cs, cy1 = cy0 + cs;
+				for(int i = 0; i < B; ++i) {
+					double cx0 = (b.bx*B + i)*cs, cx1 = cx0 + cs;
+					float v = t[0][s*B*B + j*B + i];
+					for(int py = int(cy0/factor); py < std::min(h, int(std::ceil(cy1/factor))); ++py) {
+						double oy = std::min(cy1, double(py + 1)*factor) - std::max(cy0, double(py)*factor);
+						for(int px = int(cx0/factor); px < std::min(w, int(std::ceil(cx1/factor))); ++px) {
+							double ox = std::min(cx1, double(px + 1)*factor) - std::max(cx0, double(px)*factor);
+							if(ox <= 0.0 || oy <= 0.0)
+								continue;
+							float &d = data.at(0, px, py);
+							if(mode == BOX) {
+								d += float(ox*oy)*v;
+								weight.at(0, px, py) += float(ox*oy);
+							} else {
+								d = mode == MIN ? std::min(d, v) : std::max(d, v);
+							}
+						}
+					}
+				}
+			}
+		}
+		if(mode == BOX) {
+			for(int py = 0; py < h; ++py) {
+				float *d = data.row(0, py);
+				const float *wr = weight.row(0, py);
+				for(int px = 0; px < w; ++px) {
+					d[px] = wr[px] > 0.0f ? d[px]/wr[px] : 0.0f;
+				}
+			}
+		}
+	}
+	
+	void readField(Field2D &data) override {
+		readField(data, 1, POINT);
+	}
+	
+	/* heat is counted in units of the finest cells like on the uniform grid */
+	bool requestStats(long tag) override {
+		Stats st = {0.0f, 1e30f, -1e30f};
+		double sum = 0.0;
+		for(int s : leaves) {
+			double cs = cellSize(blocks[s].level);
+			double bsum = 0.0;
+			for(int c = s*B*B; c < (s + 1)*B*B; ++c) {
+				bsum += t[0][c];
+				st.min = std::min(st.min, t[0][c]);
+				st.max = std::max(st.max, t[0][c]);
+			}
+			sum += bsum*cs*cs;
+		}
+		st.sum = float(sum);
+		return pushStats(tag, st);
+	}
+	
+	void copy(gl::FrameBuffer *dst) override {
+		rasterize(dst->width(), dst->height(), host);
+		view.draw(host, dst);
+	}
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdio>
+
+#include <memory>
+#include <stdexcept>
+
+#include "solver.hpp"
+#include "glsolver.hpp"
+#include "amrsolver.hpp"
+#include "hybridsolver.hpp"
+#include "oocsolver.hpp"
+#include "pararealsolver.hpp"
+#ifdef THERM_OPENCL
+#include "clsolver.hpp"
+#endif
+
+#include "options.hpp"
+
+/* Creates the solver chosen by the options, initialized to the start
+ * state. Must be called with the GL context of the solver thread current. */
+inline std::unique_ptr<Solver> createSolver(const Options &opts) {
+	std::unique_ptr<Solver> solver;
+	switch(opts.backend) {
+	case Solver::GL:
+		solver.reset(new GLSolver(opts.integrator, opts.dt, opts.pass_timing));
+		break;
+	case Solver::OPENCL:
+#ifdef THERM_OPENCL
+		solver.reset(new CLSolver(opts.integrator, opts.dt, opts.cl_device));
+		break;
+#else
+		throw std::runtime_error("Built without OpenCL, rebuild with -DTHERM_OPENCL=ON");
+#endif
+	case Solver::AMR:
+		solver.reset(new AMRSolver(opts.integrator, opts.dt, opts.amr_tol, opts.amr_every));
+		break;
+	case Solver::HYBRID:
+		solver.reset(new HybridSolver(opts.integrator, opts.dt));
+		break;
+	case Solver::OOC:
+		solver.reset(new OOCSolver(opts.integrator, opts.dt, opts.ooc_file, opts.ooc_fuse, size_t(opts.ooc_memory) << 20));
+		break;
+	case Solver::PARAREAL:
+		solver.reset(new PararealSolver(
+		  opts.integrator, opts.dt, opts.parareal_slices, opts.parareal_coarse, opts.parareal_grid, opts.parareal_tol
+		));
+		break;
+	}
+	solver->start(opts.size, opts.size);
+	return solver;
+}
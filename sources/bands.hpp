@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Worker threads kept for the life of the process that run a function
+ * over bands of rows, band i of n taking rows [h*i/n, h*(i + 1)/n). The
+ * caller computes band 0 itself. One call runs at a time; a call made
+ * while another is running, from a worker included, computes its bands
+ * in turn on the calling thread, so callers never wait for each other. */
+class Bands {
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable cv_work, cv_done;
+	const std::function<void(int, int, int)> *job = nullptr;
+	int job_bands = 0, job_height = 0, pending = 0;
+	long generation = 0;
+	bool closing = false;
+	/* a call is running */
+	std::atomic<bool> running{false};
+	
+	void loop(int index) {
+		long seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			cv_work.wait(lock, [&]() { return closing || generation != seen; });
+			if(closing)
+				return;
+			seen = generation;
+			if(index >= job_bands)
+				continue;
+			const std::function<void(int, int, int)> &f = *job;
+			int n = job_bands, h = job_height;
+			lock.unlock();
+			f(index, h*index/n, h*(index + 1)/n);
+			lock.lock();
+			if(--pending == 0)
+				cv_done.notify_all();
+		}
+	}
+
+public:
+	explicit Bands(int threads) {
+		for(int i = 1; i < threads; ++i) {
+			workers.push_back(std::thread(&Bands::loop, this, i));
+		}
+	}
+	~Bands() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closing = true;
+		}
+		cv_work.notify_all();
+		for(std::thread &th : workers) {
+			th.join();
+		}
+	}
+	Bands(const Bands &) = delete;
+	Bands &operator=(const Bands &) = delete;
+	
+	/* threads of the shared pool */
+	static int count() {
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+	static Bands &shared() {
+		static Bands pool(count());
+		return pool;
+	}
+	
+	int size() const {
+		return int(workers.size()) + 1;
+	}
+	
+	/* f(band, y0, y1) over h rows in bands of at least min_rows, at most max_bands of them if positive */
+	void run(int h, int min_rows, const std::function<void(int, int, int)> &f, int max_bands = 0) {
+		int n = max_bands > 0 ? std::min(max_bands, size()) : size();
+		n = std::max(1, std::min(n, h/std::max(1, min_rows)));
+		bool idle = false;
+		if(n == 1 || !running.compare_exchange_strong(idle, true)) {
+			for(int i = 0; i < n; ++i) {
+				f(i, h*i/n, h*(i + 1)/n);
+			}
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &f;
+			job_bands = n;
+			job_height = h;
+			pending = n - 1;
+			generation += 1;
+		}
+		cv_work.notify_all();
+		f(0, 0, h/n);
+		std::unique_lock<std::mutex> lock(mutex);
+		cv_done.wait(lock, [this]() { return pending == 0; });
+		job = nullptr;
+		running = false;
+	}
+};
+
+/* Euler step of the 5-point operator for a row of width cells, below and
+ * above are the neighbouring rows, or the row itself at the grid edges so
+ * that no heat crosses them; fdt is dt over the squared cell size */
+inline void eulerRow(const float *t, const float *below, const float *above, const float *k, float *d, int width, float fdt) {
+	for(int ix = 0; ix < width; ++ix) {
+		float tc = t[ix];
+		float n =
+		  below[ix] + above[ix] +
+		  (ix > 0 ? t[ix - 1] : tc) + (ix < width - 1 ? t[ix + 1] : tc);
+		d[ix] = tc - fdt*k[ix]*(4.0f*tc - n);
+	}
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#define CL_TARGET_OPENCL_VERSION 120
+
+#include <cstdio>
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <utility>
+
+#include <CL/cl.h>
+
+#include "solver.hpp"
+#include "hostview.hpp"
+#include "programs.hpp"
+
+/* Heat diffusion on an OpenCL device, which may as well be a CPU
+ * implementation like pocl. The field stays on the device between
+ * steps and is brought to the host only to be read or displayed. */
+class CLSolver : public Solver {
+private:
+	static const int BUFFERS = 4;
+	
+	cl_device_id device = nullptr;
+	cl_context context = nullptr;
+	cl_command_queue queue = nullptr;
+	cl_program program = nullptr;
+	cl_kernel diffuse = nullptr, rkl2 = nullptr;
+	/* t[0] holds the current temperature, the rest are stage targets */
+	cl_mem t[BUFFERS] = {nullptr};
+	cl_mem cond = nullptr;
+	int sx = 0, sy = 0;
+	
+	HostView view;
+	Field2D host;
+	
+	static void check(cl_int err, const char *what) {
+		if(err != CL_SUCCESS)
+			throw std::runtime_error(std::string("OpenCL: ") + what + " failed with error " + std::to_string(err));
+	}
+	
+	/* index counts the devices of all platforms in order */
+	static cl_device_id findDevice(int index) {
+		cl_uint np = 0;
+		check(clGetPlatformIDs(0, nullptr, &np), "clGetPlatformIDs");
+		std::vector<cl_platform_id> platforms(np);
+		check(clGetPlatformIDs(np, platforms.data(), nullptr), "clGetPlatformIDs");
+		for(cl_platform_id p : platforms) {
+			cl_uint nd = 0;
+			if(clGetDeviceIDs(p, CL_DEVICE_TYPE_ALL, 0, nullptr, &nd) != CL_SUCCESS)
+				continue;
+			std::vector<cl_device_id> devices(nd);
+			check(clGetDeviceIDs(p, CL_DEVICE_TYPE_ALL, nd, devices.data(), nullptr), "clGetDeviceIDs");
+			if(index < int(nd))
+				return devices[index];
+			index -= nd;
+		}
+		throw std::runtime_error("OpenCL: no such device");
+	}
+	
+	void releaseBuffers() {
+		for(cl_mem &m : t) {
+			if(m != nullptr)
+				clReleaseMemObject(m);
+			m = nullptr;
+		}
+		if(cond != nullptr)
+			clReleaseMemObject(cond);
+		cond = nullptr;
+	}
+	
+	/* moves channel c between a device buffer and the padded rows of a field */
+	void writePlane(cl_mem m, const Field2D &f, int c, cl_bool block) {
+		size_t origin[] = {0, 0, 0}, region[] = {sizeof(float)*sx, size_t(sy), 1};
+		check(clEnqueueWriteBufferRect(
+		  queue, m, block, origin, origin, region, sizeof(float)*sx, 0,
+		  sizeof(float)*f.stride(), 0, f.plane(c), 0, nullptr, nullptr
+		), "clEnqueueWriteBufferRect");
+	}
+	void readPlane(cl_mem m, Field2D &f, int c, cl_bool block) {
+		size_t origin[] = {0, 0, 0}, region[] = {sizeof(float)*sx, size_t(sy), 1};
+		check(clEnqueueReadBufferRect(
+		  queue, m, block, origin, origin, region, sizeof(float)*sx, 0,
+		  sizeof(float)*f.stride(), 0, f.plane(c), 0, nullptr, nullptr
+		), "clEnqueueReadBufferRect");
+	}
+	
+	void run(cl_kernel k) {
+		size_t global[] = {size_t(sx), size_t(sy)};
+		check(clEnqueueNDRangeKernel(queue, k, 2, nullptr, global, nullptr, 0, nullptr, nullptr), "clEnqueueNDRangeKernel");
+	}
+	
+	void stepEuler() {
+		clSetKernelArg(diffuse, 0, sizeof(cl_mem), &t[0]);
+		clSetKernelArg(diffuse, 1, sizeof(cl_mem), &cond);
+		clSetKernelArg(diffuse, 2, sizeof(cl_mem), &t[1]);
+		run(diffuse);
+		std::swap(t[0], t[1]);
+	}
+	
+	void stepRKL2() {
+		int prev = 0, prev2 = 0;
+		clSetKernelArg(rkl2, 2, sizeof(cl_mem), &t[0]);
+		clSetKernelArg(rkl2, 3, sizeof(cl_mem), &cond);
+		/* stage j overwrites the result of stage j - 3 */
+		int next = 1;
+		for(size_t i = 0; i < stages.size(); i += 4) {
+			cl_float4 coef = {{stages[i], stages[i + 1], stages[i + 2], stages[i + 3]}};
+			clSetKernelArg(rkl2, 0, sizeof(cl_mem), &t[prev]);
+			clSetKernelArg(rkl2, 1, sizeof(cl_mem), &t[prev2]);
+			clSetKernelArg(rkl2, 4, sizeof(cl_mem), &t[next]);
+			clSetKernelArg(rkl2, 7, sizeof(cl_float4), &coef);
+			run(rkl2);
+			prev2 = prev;
+			prev = next;
+			next = next % (BUFFERS - 1) + 1;
+		}
+		std::swap(t[0], t[prev]);
+	}
+
+protected:
+	void load(const Field2D &state) override {
+		releaseBuffers();
+		sx = state.width();
+		sy = state.height();
+		cl_int err;
+		for(cl_mem &m : t) {
+			m = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float)*sx*sy, nullptr, &err);
+			check(err, "clCreateBuffer");
+		}
+		cond = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float)*sx*sy, nullptr, &err);
+		check(err, "clCreateBuffer");
+		
+		writePlane(t[0], state, TEMP, CL_FALSE);
+		writePlane(cond, state, COND, CL_TRUE);
+		
+		cl_int size[] = {sx, sy};
+		float step_dt = float(dt);
+		clSetKernelArg(diffuse, 3, sizeof(size), size);
+		clSetKernelArg(diffuse, 4, sizeof(float), &step_dt);
+		clSetKernelArg(rkl2, 5, sizeof(size), size);
+		clSetKernelArg(rkl2, 6, sizeof(float), &step_dt);
+	}
+
+public:
+	/* must be created with a GL context current, which frames are rendered in */
+	CLSolver(Integrator integ = EULER, double step_dt = 0.1, int device_index = 0) : Solver(integ, step_dt) {
+		device = findDevice(device_index);
+		char dev_name[256] = "";
+		clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(dev_name), dev_name, nullptr);
+		fprintf(stderr, "OpenCL device: %s\n", dev_name);
+		
+		cl_int err;
+		context = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &err);
+		check(err, "clCreateContext");
+		queue = clCreateCommandQueue(context, device, 0, &err);
+		check(err, "clCreateCommandQueue");
+		
+		std::string src = Programs::source("diffuse.cl");
+		const char *text = src.c_str();
+		size_t len = src.size();
+		program = clCreateProgramWithSource(context, 1, &text, &len, &err);
+		check(err, "clCreateProgramWithSource");
+		if(clBuildProgram(program, 1, &device, "", nullptr, nullptr) != CL_SUCCESS) {
+			size_t log_size = 0;
+			clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &log_size);
+			std::string log(log_size, '\0');
+			clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, &log[0], nullptr);
+			fprintf(stderr, "diffuse.cl:\n%s\n", log.c_str());
+			check(CL_BUILD_PROGRAM_FAILURE, "clBuildProgram");
+		}
+		diffuse = clCreateKernel(program, "diffuse", &err);
+		check(err, "clCreateKernel");
+		rkl2 = clCreateKernel(program, "rkl2", &err);
+		check(err, "clCreateKernel");
+	}
+	/* devices of all platforms, to be tried by index */
+	static int deviceCount() {
+		cl_uint np = 0;
+		if(clGetPlatformIDs(0, nullptr, &np) != CL_SUCCESS)
+			return 0;
+		std::vector<cl_platform_id> platforms(np);
+		clGetPlatformIDs(np, platforms.data(), nullptr);
+		int count = 0;
+		for(cl_platform_id p : platforms) {
+			cl_uint nd = 0;
+			if(clGetDeviceIDs(p, CL_DEVICE_TYPE_ALL, 0, nullptr, &nd) == CL_SUCCESS)
+				count += nd;
+		}
+		return count;
+	}
+	
+	~CLSolver() {
+		releaseBuffers();
+		if(diffuse != nullptr)
+			clReleaseKernel(diffuse);
+		if(rkl2 != nullptr)
+			clReleaseKernel(rkl2);
+		if(program != nullptr)
+			clReleaseProgram(program);
+		if(queue != nullptr)
+			clReleaseCommandQueue(queue);
+		if(context != nullptr)
+			clReleaseContext(context);
+	}
+	
+	const char *name() const override {
+		return "opencl";
+	}
+	int width() const override {
+		return sx;
+	}
+	int height() const override {
+		return sy;
+	}
+	
+	void step(int n) override {
+		for(int i = 0; i < n; ++i) {
+			switch(integrator) {
+			case EULER:
+				stepEuler();
+				break;
+			case RKL2:
+				stepRKL2();
+				break;
+			}
+		}
+		clFlush(queue);
+	}
+	
+	void readField(Field2D &data) override {
+		data.resize(1, sx, sy);
+		readPlane(t[0], data, 0, CL_TRUE);
+	}
+	
+	void readState(Field2D &state) override {
+		state.resize(2, sx, sy);
+		readPlane(t[0], state, TEMP, CL_FALSE);
+		readPlane(cond, state, COND, CL_TRUE);
+	}
+	
+	void copy(gl::FrameBuffer *dst) override {
+		readState(host);
+		view.draw(host, dst);
+	}
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+
+#include <GL/glew.h>
+
+#include "opengl/framebuffer.hpp"
+
+/* Hands completed frames from the simulation context to the display one.
+ * Three slots rotate between the producer (back), the consumer (front)
+ * and the latest completed frame in between, so neither side ever waits
+ * for the other on the CPU. The GPU work on a slot is ordered across
+ * the contexts by fences which travel along with the slot. */
+class FrameExchange {
+public:
+	/* frames are at most this large, about the size of a screen;
+	 * larger fields are zoomed into rather than sent in full */
+	static const int MAX_FRAME = 2048;
+
+private:
+	static const int FRESH = 4;
+	
+	struct Slot {
+		gl::FrameBuffer fb;
+		/* rendering into fb by producer, sampling from it by consumer */
+		GLsync written = nullptr, read = nullptr;
+	};
+	
+	Slot slots[3];
+	int back = 0, front = 1;
+	std::atomic<int> middle{2};
+	bool has_front = false;
+	
+	static bool fences() {
+		return GLEW_VERSION_3_2 || GLEW_ARB_sync;
+	}
+	static void wait(GLsync &sync) {
+		if(sync != nullptr) {
+			glWaitSync(sync, 0, GL_TIMEOUT_IGNORED);
+			glDeleteSync(sync);
+			sync = nullptr;
+		}
+	}
+	static void signal(GLsync &sync) {
+		if(!fences()) {
+			glFinish();
+			return;
+		}
+		if(sync != nullptr)
+			glDeleteSync(sync);
+		sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		/* the fence must reach the GPU before other context waits for it */
+		glFlush();
+	}
+
+public:
+	/* producer side, must be called with the producer context current */
+	void create(int width, int height) {
+		for(Slot &s : slots) {
+			s.fb.setSize(width, height);
+		}
+	}
+	void destroy() {
+		for(Slot &s : slots) {
+			if(s.written != nullptr)
+				glDeleteSync(s.written);
+			if(s.read != nullptr)
+				glDeleteSync(s.read);
+			s = Slot();
+		}
+	}
+	
+	/* framebuffer to render the next frame into */
+	gl::FrameBuffer *acquireBack() {
+		Slot &s = slots[back];
+		wait(s.read);
+		return &s.fb;
+	}
+	void publishBack() {
+		signal(slots[back].written);
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+	}
+	
+	/* consumer side, returns the latest frame or nullptr if there was none yet */
+	const gl::Texture *acquireFront() {
+		if(middle.load(std::memory_order_acquire) & FRESH) {
+			front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+			has_front = true;
+			wait(slots[front].written);
+		}
+		return has_front ? slots[front].fb.getTexture() : nullptr;
+	}
+	/* to be called after the front frame was drawn */
+	void releaseFront() {
+		if(has_front)
+			signal(slots[front].read);
+	}
+};
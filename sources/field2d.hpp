@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <new>
+
+#include <sys/mman.h>
+
+#include "bands.hpp"
+
+/* Grid of float channels in host memory, each channel a separate plane,
+ * so loops over a channel run over contiguous aligned rows. Rows are
+ * padded to 64 bytes. Large fields are mapped directly, optionally on
+ * huge pages, and zeroed in parallel by the band threads. */
+class Field2D {
+public:
+	/* bytes rows are aligned and padded to */
+	static const int ALIGN = 64;
+	
+	enum Pages {
+		/* regular pages */
+		SMALL,
+		/* transparent huge pages, asked for with madvise */
+		THP,
+		/* reserved huge pages of MAP_HUGETLB, THP if there are none left */
+		HUGETLB
+	};
+
+private:
+	/* fields from this size on are mapped and touched by threads */
+	static const size_t MAP_SIZE = size_t(4) << 20;
+	static const size_t HUGE_PAGE = size_t(2) << 20;
+	
+	float *_data = nullptr;
+	size_t _bytes = 0;
+	bool _mapped = false;
+	int _channels = 0, _width = 0, _height = 0, _stride = 0;
+	
+	static Pages &_pages() {
+		static Pages pages = THP;
+		return pages;
+	}
+	
+	void _allocate(size_t bytes) {
+		if(bytes < MAP_SIZE) {
+			void *p = nullptr;
+			if(posix_memalign(&p, ALIGN, bytes) != 0)
+				throw std::bad_alloc();
+			_data = static_cast<float *>(p);
+			_bytes = bytes;
+			_mapped = false;
+			return;
+		}
+		void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		if(_pages() == HUGETLB) {
+			size_t huge = (bytes + HUGE_PAGE - 1)/HUGE_PAGE*HUGE_PAGE;
+			p = mmap(nullptr, huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if(p != MAP_FAILED)
+				bytes = huge;
+		}
+#endif
+		if(p == MAP_FAILED) {
+			p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if(p == MAP_FAILED)
+				throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+			if(_pages() != SMALL)
+				madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+		}
+		_data = static_cast<float *>(p);
+		_bytes = bytes;
+		_mapped = true;
+	}
+	void _release() {
+		if(_data == nullptr)
+			return;
+		if(_mapped)
+			munmap(_data, _bytes);
+		else
+			free(_data);
+		_data = nullptr;
+		_bytes = 0;
+	}
+	void _take(Field2D &f) {
+		_data = f._data;
+		_bytes = f._bytes;
+		_mapped = f._mapped;
+		_channels = f._channels;
+		_width = f._width;
+		_height = f._height;
+		_stride = f._stride;
+		f._data = nullptr;
+		f._bytes = 0;
+		f._channels = 0;
+		f._width = 0;
+		f._height = 0;
+		f._stride = 0;
+	}
+	
+	/* zeroes rows [y0, y1) of every channel */
+	void _clear(int y0, int y1) {
+		for(int c = 0; c < _channels; ++c) {
+			memset(row(c, y0), 0, sizeof(float)*_stride*(y1 - y0));
+		}
+	}
+	/* zeroes every row, over bands of rows for mapped fields */
+	void _touch() {
+		if(!_mapped) {
+			_clear(0, _height);
+			return;
+		}
+		Bands::shared().run(_height, 1, [this](int, int y0, int y1) { _clear(y0, y1); });
+	}
+
+public:
+	/* backing of fields allocated from now on */
+	static void setPages(Pages pages) {
+		_pages() = pages;
+	}
+	static Pages pages() {
+		return _pages();
+	}
+	/* threads splitting the rows of a field, band i has rows [h*i/n, h*(i + 1)/n) */
+	static int bands() {
+		return Bands::count();
+	}
+	/* floats per row of the given width, padding included */
+	static int strideOf(int width) {
+		int per_line = ALIGN/sizeof(float);
+		return (width + per_line - 1)/per_line*per_line;
+	}
+	
+	Field2D() = default;
+	Field2D(int channels, int width, int height) {
+		resize(channels, width, height);
+	}
+	~Field2D() {
+		_release();
+	}
+	Field2D(const Field2D &f) {
+		*this = f;
+	}
+	Field2D &operator=(const Field2D &f) {
+		if(this != &f) {
+			resize(f._channels, f._width, f._height);
+			if(_data != nullptr)
+				memcpy(_data, f._data, sizeof(float)*_stride*_height*_channels);
+		}
+		return *this;
+	}
+	Field2D(Field2D &&f) {
+		_take(f);
+	}
+	Field2D &operator=(Field2D &&f) {
+		if(this != &f) {
+			_release();
+			_take(f);
+		}
+		return *this;
+	}
+	
+	/* keeps the contents if nothing changes, zeroes them otherwise */
+	void resize(int channels, int width, int height) {
+		if(channels == _channels && width == _width && height == _height)
+			return;
+		_release();
+		_channels = channels;
+		_width = width;
+		_height = height;
+		_stride = strideOf(width);
+		size_t bytes = sizeof(float)*_stride*_height*_channels;
+		if(bytes == 0)
+			return;
+		_allocate(bytes);
+		_touch();
+	}
+	
+	int channels() const {
+		return _channels;
+	}
+	int width() const {
+		return _width;
+	}
+	int height() const {
+		return _height;
+	}
+	/* floats from one row to the next */
+	int stride() const {
+		return _stride;
+	}
+	
+	float *row(int c, int y) {
+		return _data + (size_t(c)*_height + y)*_stride;
+	}
+	const float *row(int c, int y) const {
+		return _data + (size_t(c)*_height + y)*_stride;
+	}
+	float *plane(int c) {
+		return row(c, 0);
+	}
+	const float *plane(int c) const {
+		return row(c, 0);
+	}
+	float &at(int c, int x, int y) {
+		return row(c, y)[x];
+	}
+	float at(int c, int x, int y) const {
+		return row(c, y)[x];
+	}
+	
+	void fill(int c, float value) {
+		for(int y = 0; y < _height; ++y) {
+			std::fill(row(c, y), row(c, y) + _width, value);
+		}
+	}
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "field2d.hpp"
+
+/* Field kept in a binary file with the layout of Field2D: a header page,
+ * then the channels one plane after the other with rows padded to the
+ * stride of Field2D, in host byte order. The rows of a channel are
+ * contiguous, so a band of rows moves between the file and a field of
+ * the same width in a single call. */
+class FieldFile {
+public:
+	/* bytes before the first plane, a page so that planes stay aligned */
+	static const size_t HEADER = 4096;
+	static const uint32_t VERSION = 1;
+
+private:
+	int fd = -1;
+	std::string path;
+	int _channels = 0, _width = 0, _height = 0, _stride = 0;
+	
+	void fail(const char *what) const {
+		throw std::runtime_error(std::string(what) + " '" + path + "': " + strerror(errno));
+	}
+	off_t offset(int c, int y) const {
+		return off_t(HEADER) + (off_t(c)*_height + y)*_stride*off_t(sizeof(float));
+	}
+	
+	void transfer(void *data, size_t size, off_t pos, bool write) const {
+		char *p = static_cast<char *>(data);
+		while(size > 0) {
+			ssize_t done = write ? pwrite(fd, p, size, pos) : pread(fd, p, size, pos);
+			if(done < 0 && errno == EINTR)
+				continue;
+			if(done <= 0) {
+				if(done == 0)
+					errno = EIO;
+				fail(write ? "error write field file" : "error read field file");
+			}
+			p += done;
+			pos += done;
+			size -= done;
+		}
+	}
+
+public:
+	FieldFile() = default;
+	~FieldFile() {
+		close();
+	}
+	FieldFile(const FieldFile &) = delete;
+	FieldFile &operator=(const FieldFile &) = delete;
+	
+	/* creates or truncates the file, an empty name makes an unlinked temporary one */
+	void create(const std::string &fn, int channels, int width, int height) {
+		close();
+		if(fn.empty()) {
+			const char *dir = getenv("TMPDIR");
+			path = std::string(dir != nullptr && *dir != '\0' ? dir : "/tmp") + "/therm-XXXXXX";
+			fd = mkstemp(&path[0]);
+			if(fd < 0)
+				fail("error create field file");
+			unlink(path.c_str());
+		} else {
+			path = fn;
+			fd = open(fn.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if(fd < 0)
+				fail("error create field file");
+		}
+		_channels = channels;
+		_width = width;
+		_height = height;
+		_stride = Field2D::strideOf(width);
+		if(ftruncate(fd, offset(channels, 0)) != 0)
+			fail("error resize field file");
+		
+		char head[HEADER] = {'T', 'H', 'R', 'M', 'F', 'L', 'D', '\0'};
+		uint32_t fields[] = {VERSION, uint32_t(channels), uint32_t(width), uint32_t(height), uint32_t(_stride)};
+		memcpy(head + 8, fields, sizeof(fields));
+		transfer(head, HEADER, 0, true);
+#ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	}
+	void close() {
+		if(fd >= 0)
+			::close(fd);
+		fd = -1;
+	}
+	
+	int channels() const {
+		return _channels;
+	}
+	int width() const {
+		return _width;
+	}
+	int height() const {
+		return _height;
+	}
+	/* bytes of a padded row */
+	size_t rowBytes() const {
+		return sizeof(float)*_stride;
+	}
+	
+	/* rows [y0, y1) of channel c from or to consecutive rows of a field of the same width */
+	void readRows(int c, int y0, int y1, float *dst) const {
+		transfer(dst, rowBytes()*(y1 - y0), offset(c, y0), false);
+	}
+	void writeRows(int c, int y0, int y1, const float *src) const {
+		transfer(const_cast<float *>(src), rowBytes()*(y1 - y0), offset(c, y0), true);
+	}
+	float readCell(int c, int x, int y) const {
+		float v;
+		transfer(&v, sizeof(v), offset(c, y) + off_t(sizeof(float))*x, false);
+		return v;
+	}
+};
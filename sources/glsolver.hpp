@@ -0,0 +1,455 @@
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include <GL/glew.h>
+
+#include "opengl/program.hpp"
+#include "opengl/framebuffer.hpp"
+#include "opengl/sampler.hpp"
+#include "opengl/pixelbuffer.hpp"
+#include "opengl/pool.hpp"
+
+#include "programs.hpp"
+#include "solver.hpp"
+#include "passgraph.hpp"
+
+/* Heat diffusion on the GPU, renders into its own framebuffers only
+ * and therefore may run in any context sharing objects with the display one.
+ * A step, the readback downsampling and the stats reduction are pass graphs,
+ * the step graph owns the field. */
+class GLSolver : public Solver {
+private:
+	Programs programs;
+	gl::VertexBuffer buf;
+	/* a position, radius and power per heat source, advancing per instance */
+	gl::VertexBuffer source_buf;
+	long source_count = 0;
+	gl::Texture tex;
+	gl::Sampler nearest{gl::Texture::NEAREST};
+	gl::FrameBufferPool pool;
+	/* the state of steps holds the current field */
+	PassGraph steps{&pool, &nearest, "field"};
+	PassGraph downsample{&pool, &nearest};
+	PassGraph reduce{&pool, &nearest};
+	/* downsampled field to be read back */
+	gl::FrameBuffer small;
+	int small_factor = 1;
+	Reduction small_mode = POINT;
+	
+	/* reduction levels down to a single pixel */
+	std::vector<gl::FrameBuffer> reduce_fb;
+	/* ring of stats readbacks in flight, oldest at stats_head */
+	std::unique_ptr<gl::PixelBuffer> stats_pb[STATS_QUEUE];
+	long stats_tag[STATS_QUEUE];
+	int stats_head = 0, stats_count = 0;
+	
+	/* samples gathered on the GPU per readback */
+	static const int PROBE_BATCH = 64;
+	static const int PROBE_QUEUE = 4;
+	/* probe positions, a texel each */
+	gl::Texture probe_tex;
+	/* a row of probe values per sample, up to PROBE_BATCH rows */
+	gl::FrameBuffer probe_fb;
+	/* steps of the rows written since the last readback */
+	std::vector<long> probe_steps;
+	/* ring of probe batches in flight, oldest at probe_head */
+	std::unique_ptr<gl::PixelBuffer> probe_pb[PROBE_QUEUE];
+	std::vector<long> probe_batch[PROBE_QUEUE];
+	int probe_head = 0, probe_count = 0;
+	
+	void setAreaSize(int sx, int sy) {
+		int area_size_data[] = {sx, sy};
+		programs["diffuse"]->setUniform("u_area_size", area_size_data, 2);
+		programs["rkl2"]->setUniform("u_area_size", area_size_data, 2);
+		programs["downsample"]->setUniform("u_area_size", area_size_data, 2);
+		programs["splat"]->setUniform("u_area_size", area_size_data, 2);
+	}
+	
+	/* a step of the integrator as passes from field to field */
+	void buildSteps() {
+		steps.clear();
+		switch(integrator) {
+		case EULER:
+			steps.add(PassGraph::Pass("diffuse", programs["diffuse"], {{"u_source", "field"}}, "field"));
+			break;
+		case RKL2: {
+			/* stage j reads the results of the two stages before it */
+			int n = int(stages.size()/4);
+			std::string prev = "field", prev2 = "field";
+			for(int j = 0; j < n; ++j) {
+				std::string out = j + 1 < n ? "stage" + std::to_string(j) : "field";
+				steps.add(PassGraph::Pass(
+				  "rkl2", programs["rkl2"],
+				  {{"u_initial", "field"}, {"u_source", prev}, {"u_source_prev", prev2}}, out,
+				  [this, j](gl::Program *prog) { prog->setUniform("u_coef", &stages[4*j], 4); }
+				));
+				prev2 = prev;
+				prev = out;
+			}
+			break;
+		}
+		}
+	}
+	
+	/* levels of the stats reduction for the current grid size */
+	void buildReduce() {
+		static const int FACTOR = 8;
+		for(gl::FrameBuffer &r : reduce_fb) {
+			pool.release(std::move(r));
+		}
+		reduce_fb.clear();
+		reduce.clear();
+		int w = width(), h = height();
+		std::string src = "field";
+		for(int level = 0; w > 1 || h > 1; ++level) {
+			int tw = (w + FACTOR - 1)/FACTOR, th = (h + FACTOR - 1)/FACTOR;
+			reduce_fb.push_back(pool.acquire(tw, th));
+			std::string out = "level" + std::to_string(level);
+			reduce.add(PassGraph::Pass(
+			  "reduce", programs["reduce"], {{"u_source", src}}, out,
+			  [w, h, tw, th, level](gl::Program *prog) {
+				int area_size[] = {w, h}, target_size[] = {tw, th};
+				prog->setUniform("u_area_size", area_size, 2);
+				prog->setUniform("u_target_size", target_size, 2);
+				prog->setUniform("u_first", int(level == 0));
+			  }
+			));
+			src = out;
+			w = tw;
+			h = th;
+		}
+		/* level vectors are complete, so the pointers stay valid */
+		for(size_t level = 0; level < reduce_fb.size(); ++level) {
+			reduce.attach("level" + std::to_string(level), &reduce_fb[level]);
+		}
+	}
+	
+	/* the other graphs read the field of steps in place */
+	void attachField() {
+		downsample.attach("field", &steps.state());
+		reduce.attach("field", &steps.state());
+	}
+
+	/* moves the oldest batch in flight to the host queue, waits for it if needed */
+	void fetchProbes() {
+		size_t n = probes.size();
+		const std::vector<long> &batch = probe_batch[probe_head];
+		std::vector<float> data(n*batch.size());
+		probe_pb[probe_head]->fetch(data.data(), sizeof(float)*data.size());
+		for(size_t r = 0; r < batch.size(); ++r) {
+			pushProbes(batch[r], std::vector<float>(data.begin() + r*n, data.begin() + (r + 1)*n));
+		}
+		probe_head = (probe_head + 1) % PROBE_QUEUE;
+		probe_count -= 1;
+	}
+	/* starts the readback of the rows written since the last one */
+	void sendProbes() {
+		if(probe_steps.empty())
+			return;
+		if(probe_count >= PROBE_QUEUE)
+			fetchProbes();
+		int i = (probe_head + probe_count) % PROBE_QUEUE;
+		probe_fb.bind();
+		probe_pb[i]->read(0, 0, probes.size(), probe_steps.size(), GL_RED, GL_FLOAT);
+		probe_batch[i].swap(probe_steps);
+		probe_steps.clear();
+		probe_count += 1;
+		gl::FrameBuffer::unbind();
+	}
+
+protected:
+	void load(const Field2D &state) override {
+		int sx = state.width(), sy = state.height();
+		std::vector<float> data(3*sx*sy, 0.0f);
+		for(int iy = 0; iy < sy; ++iy) {
+			const float *t = state.row(TEMP, iy), *k = state.row(COND, iy);
+			float *d = &data[3*iy*sx];
+			for(int ix = 0; ix < sx; ++ix) {
+				d[3*ix + 0] = t[ix];
+				d[3*ix + 1] = k[ix];
+			}
+		}
+		tex.loadData(data.data(), sx, sy, gl::Texture::RGB, gl::Texture::FLOAT, gl::Texture::NEAREST);
+		buildSteps();
+		if(sx != width() || sy != height()) {
+			steps.resize(sx, sy);
+			setAreaSize(sx, sy);
+			buildReduce();
+		}
+		attachField();
+		
+		steps.state().bind();
+		programs["texture"]->setUniform("u_texture", &tex, &nearest);
+		programs["texture"]->evaluate();
+		gl::FrameBuffer::unbind();
+	}
+
+public:
+	GLSolver(Integrator integ = EULER, double step_dt = 0.1, bool pass_timing = false) : Solver(integ, step_dt), programs({
+		  Programs::ShaderInfo("position",  "position.vert",   gl::Shader::VERTEX),
+		  Programs::ShaderInfo("texture",   "texture.frag",    gl::Shader::FRAGMENT),
+		  Programs::ShaderInfo("diffuse",   "diffuse.frag",    gl::Shader::FRAGMENT),
+		  Programs::ShaderInfo("rkl2",      "rkl2.frag",       gl::Shader::FRAGMENT),
+		  Programs::ShaderInfo("downsample", "downsample.frag", gl::Shader::FRAGMENT),
+		  Programs::ShaderInfo("reduce",    "reduce.frag",     gl::Shader::FRAGMENT),
+		  Programs::ShaderInfo("splat_vert", "splat.vert",     gl::Shader::VERTEX),
+		  Programs::ShaderInfo("splat",     "splat.frag",      gl::Shader::FRAGMENT),
+		  Programs::ShaderInfo("probe",     "probe.frag",      gl::Shader::FRAGMENT)
+		}, {
+		  Programs::ProgramInfo("texture",   "position", "texture"),
+		  Programs::ProgramInfo("diffuse",   "position", "diffuse"),
+		  Programs::ProgramInfo("rkl2",      "position", "rkl2"),
+		  Programs::ProgramInfo("downsample", "position", "downsample"),
+		  Programs::ProgramInfo("reduce",    "position", "reduce"),
+		  Programs::ProgramInfo("splat",     "splat_vert", "splat"),
+		  Programs::ProgramInfo("probe",     "position", "probe")
+		})
+	{
+		float vertex_data[] = {
+		  0, 0, 1, 0, 0, 1,
+		  0, 1, 1, 0, 1, 1
+		};
+		buf.loadData(vertex_data, 12);
+		
+		float map_data[]    = {2, 0, 0, 2};
+		float offset_data[] = {-1, -1};
+		
+		programs["texture"]->setAttribute("a_vertex", &buf);
+		programs["texture"]->setUniform("u_map", map_data, 4);
+		programs["texture"]->setUniform("u_offset", offset_data, 2);
+		
+		programs["diffuse"]->setAttribute("a_vertex", &buf);
+		programs["diffuse"]->setUniform("u_map", map_data, 4);
+		programs["diffuse"]->setUniform("u_offset", offset_data, 2);
+		programs["diffuse"]->setUniform("u_dt", float(dt));
+		
+		programs["rkl2"]->setAttribute("a_vertex", &buf);
+		programs["rkl2"]->setUniform("u_map", map_data, 4);
+		programs["rkl2"]->setUniform("u_offset", offset_data, 2);
+		programs["rkl2"]->setUniform("u_dt", float(dt));
+		
+		programs["downsample"]->setAttribute("a_vertex", &buf);
+		programs["downsample"]->setUniform("u_map", map_data, 4);
+		programs["downsample"]->setUniform("u_offset", offset_data, 2);
+		
+		programs["reduce"]->setAttribute("a_vertex", &buf);
+		programs["reduce"]->setUniform("u_map", map_data, 4);
+		programs["reduce"]->setUniform("u_offset", offset_data, 2);
+		
+		/* sources add to the field in place */
+		programs["splat"]->setAttribute("a_vertex", &buf);
+		programs["splat"]->setUniform("u_dt", float(dt));
+		programs["splat"]->setBlend(gl::State::ADD);
+		
+		programs["probe"]->setAttribute("a_vertex", &buf);
+		programs["probe"]->setUniform("u_map", map_data, 4);
+		programs["probe"]->setUniform("u_offset", offset_data, 2);
+		
+		for(int i = 0; i < STATS_QUEUE; ++i) {
+			stats_pb[i].reset(new gl::PixelBuffer(4*sizeof(float)));
+		}
+		
+		downsample.add(PassGraph::Pass(
+		  "downsample", programs["downsample"], {{"u_source", "field"}}, "small",
+		  [this](gl::Program *prog) {
+			int target_size[] = {small.width(), small.height()}, factor_data[] = {small_factor, small_factor};
+			prog->setUniform("u_target_size", target_size, 2);
+			prog->setUniform("u_factor", factor_data, 2);
+			prog->setUniform("u_mode", int(small_mode));
+		  }
+		));
+		downsample.attach("small", &small);
+		steps.setTiming(pass_timing);
+		downsample.setTiming(pass_timing);
+		reduce.setTiming(pass_timing);
+		if(pass_timing && !PassGraph::timers())
+			fprintf(stderr, "Pass timing needs timer queries, which are not supported\n");
+	}
+	
+	const char *name() const override {
+		return "gl";
+	}
+	int width() const override {
+		return steps.state().width();
+	}
+	int height() const override {
+		return steps.state().height();
+	}
+	
+	/* resamples the field to a new grid size, reusing released buffers */
+	void resize(int sx, int sy) override {
+		if(sx == width() && sy == height())
+			return;
+		gl::FrameBuffer next = pool.acquire(sx, sy);
+		copy(&next);
+		steps.setState(std::move(next));
+		setAreaSize(sx, sy);
+		buildReduce();
+		attachField();
+	}
+	
+	void step(int n) override {
+		if(source_count == 0) {
+			steps.run(n);
+		} else {
+			/* all sources in a single instanced draw after each step */
+			for(int i = 0; i < n; ++i) {
+				steps.run();
+				steps.state().bind();
+				programs["splat"]->evaluate();
+			}
+		}
+		gl::FrameBuffer::unbind();
+	}
+	
+	/* instancing needs GL 3.3 */
+	bool setSources(const std::vector<Source> &sources) override {
+		if(!GLEW_VERSION_3_3)
+			return sources.empty();
+		std::vector<float> data;
+		data.reserve(4*sources.size());
+		for(const Source &src : sources) {
+			data.insert(data.end(), {src.x, src.y, src.radius, src.power});
+		}
+		source_buf.loadData(data.data(), data.size(), GL_STREAM_DRAW);
+		source_buf.setDivisor(1);
+		programs["splat"]->setAttribute("a_source", &source_buf);
+		source_count = sources.size();
+		return true;
+	}
+	
+	/* positions live in a texture, so the field is never read back to sample them */
+	void setProbes(const std::vector<Probe> &list) override {
+		GLint max_size = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+		if(long(list.size()) > max_size)
+			throw std::runtime_error("More probes than the widest GL texture holds");
+		probe_steps.clear();
+		while(probe_count > 0)
+			fetchProbes();
+		Solver::setProbes(list);
+		pool.release(std::move(probe_fb));
+		if(probes.empty())
+			return;
+		
+		int n = probes.size();
+		std::vector<float> data;
+		data.reserve(4*n);
+		for(const Probe &p : probes) {
+			data.insert(data.end(), {std::max(0.0f, std::min(1.0f, p.x)), std::max(0.0f, std::min(1.0f, p.y)), 0.0f, 0.0f});
+		}
+		probe_tex.loadData(data.data(), n, 1, gl::Texture::RGBA, gl::Texture::FLOAT, gl::Texture::NEAREST);
+		probe_fb = pool.acquire(n, PROBE_BATCH);
+		for(int i = 0; i < PROBE_QUEUE; ++i) {
+			probe_pb[i].reset(new gl::PixelBuffer(sizeof(float)*n*PROBE_BATCH));
+		}
+		programs["probe"]->setUniform("u_probes", &probe_tex, &nearest);
+		programs["probe"]->setUniform("u_count", n);
+	}
+	/* writes a row of probe_fb, the rows are read back together once the batch is full */
+	void sampleProbes(long step) override {
+		if(probes.empty())
+			return;
+		probe_fb.bind();
+		gl::State::current().viewport(0, probe_steps.size(), probes.size(), 1);
+		programs["probe"]->setUniform("u_source", steps.state().getTexture(), &nearest);
+		programs["probe"]->evaluate();
+		gl::FrameBuffer::unbind();
+		probe_steps.push_back(step);
+		if(probe_steps.size() >= size_t(PROBE_BATCH))
+			sendProbes();
+	}
+	void flushProbes() override {
+		sendProbes();
+	}
+	bool pollProbes(long &step, std::vector<float> &values, bool wait = false) override {
+		if(Solver::pollProbes(step, values))
+			return true;
+		if(probe_count == 0 || !(wait || probe_pb[probe_head]->ready()))
+			return false;
+		fetchProbes();
+		return Solver::pollProbes(step, values);
+	}
+	
+	void copy(gl::FrameBuffer *dst) override {
+		dst->bind();
+		programs["texture"]->setUniform("u_texture", steps.state().getTexture(), &nearest);
+		programs["texture"]->evaluate();
+		gl::FrameBuffer::unbind();
+	}
+	
+	const gl::Texture *getTexture() const override {
+		return steps.state().getTexture();
+	}
+	
+	/* channels are read straight into the planes of the state */
+	void readState(Field2D &state) override {
+		state.resize(2, width(), height());
+		steps.state().readFloats(0, 0, width(), height(), GL_RED, state.plane(TEMP), state.stride());
+		steps.state().readFloats(0, 0, width(), height(), GL_GREEN, state.plane(COND), state.stride());
+		gl::FrameBuffer::unbind();
+	}
+	
+	void readField(Field2D &data) override {
+		data.resize(1, width(), height());
+		steps.state().readFloats(0, 0, width(), height(), GL_RED, data.plane(0), data.stride());
+		gl::FrameBuffer::unbind();
+	}
+	
+	/* the reduction runs on the GPU so only the result is transferred */
+	void readField(Field2D &data, int factor, Reduction mode) override {
+		if(factor <= 1) {
+			readField(data);
+			return;
+		}
+		int w = (width() + factor - 1)/factor;
+		int h = (height() + factor - 1)/factor;
+		if(small.width() != w || small.height() != h) {
+			pool.release(std::move(small));
+			small = pool.acquire(w, h);
+		}
+		small_factor = factor;
+		small_mode = mode;
+		downsample.run();
+		
+		data.resize(1, w, h);
+		small.readFloats(0, 0, w, h, GL_RED, data.plane(0), data.stride());
+		gl::FrameBuffer::unbind();
+	}
+	
+	bool requestStats(long tag) override {
+		if(stats_count >= STATS_QUEUE)
+			return false;
+		reduce.run();
+		
+		int i = (stats_head + stats_count) % STATS_QUEUE;
+		stats_pb[i]->read(0, 0, 1, 1, GL_RGBA, GL_FLOAT);
+		stats_tag[i] = tag;
+		stats_count += 1;
+		gl::FrameBuffer::unbind();
+		return true;
+	}
+	bool pollStats(long &tag, Stats &stats) override {
+		if(stats_count == 0 || !stats_pb[stats_head]->ready())
+			return false;
+		float data[4];
+		stats_pb[stats_head]->fetch(data, sizeof(data));
+		stats.sum = data[0];
+		stats.min = data[1];
+		stats.max = data[2];
+		tag = stats_tag[stats_head];
+		stats_head = (stats_head + 1) % STATS_QUEUE;
+		stats_count -= 1;
+		return true;
+	}
+};
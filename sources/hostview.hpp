@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "opengl/program.hpp"
+#include "opengl/framebuffer.hpp"
+#include "opengl/sampler.hpp"
+
+#include "programs.hpp"
+#include "field2d.hpp"
+
+/* Renders a state kept in host memory into a framebuffer, so solvers
+ * computing outside of GL hand frames to the display like the GL one. */
+class HostView {
+private:
+	Programs programs;
+	gl::VertexBuffer buf;
+	gl::Texture tex;
+	gl::Sampler nearest{gl::Texture::NEAREST};
+	std::vector<float> data;
+
+public:
+	HostView() : programs({
+		  Programs::ShaderInfo("position",  "position.vert",   gl::Shader::VERTEX),
+		  Programs::ShaderInfo("texture",   "texture.frag",    gl::Shader::FRAGMENT)
+		}, {
+		  Programs::ProgramInfo("texture",   "position", "texture")
+		})
+	{
+		float vertex_data[] = {
+		  0, 0, 1, 0, 0, 1,
+		  0, 1, 1, 0, 1, 1
+		};
+		buf.loadData(vertex_data, 12);
+		
+		float map_data[]    = {2, 0, 0, 2};
+		float offset_data[] = {-1, -1};
+		
+		programs["texture"]->setAttribute("a_vertex", &buf);
+		programs["texture"]->setUniform("u_map", map_data, 4);
+		programs["texture"]->setUniform("u_offset", offset_data, 2);
+	}
+	
+	/* state holds temperature and conductivity in its first two channels */
+	void draw(const Field2D &state, gl::FrameBuffer *dst) {
+		int sx = state.width(), sy = state.height();
+		data.resize(3*sx*sy);
+		for(int iy = 0; iy < sy; ++iy) {
+			const float *t = state.row(0, iy), *k = state.row(1, iy);
+			float *d = &data[3*iy*sx];
+			for(int ix = 0; ix < sx; ++ix) {
+				d[3*ix + 0] = t[ix];
+				d[3*ix + 1] = k[ix];
+				d[3*ix + 2] = 0.0f;
+			}
+		}
+		if(tex.width() != sx || tex.height() != sy)
+			tex.loadData(data.data(), sx, sy, gl::Texture::RGB, gl::Texture::FLOAT, gl::Texture::NEAREST);
+		else
+			tex.updateData(data.data());
+		
+		dst->bind();
+		programs["texture"]->setUniform("u_texture", &tex, &nearest);
+		programs["texture"]->evaluate();
+		gl::FrameBuffer::unbind();
+	}
+};
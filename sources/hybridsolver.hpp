@@ -0,0 +1,350 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "opengl/program.hpp"
+#include "opengl/framebuffer.hpp"
+#include "opengl/sampler.hpp"
+#include "opengl/mappedbuffer.hpp"
+
+#include "programs.hpp"
+#include "solver.hpp"
+#include "hostview.hpp"
+#include "bands.hpp"
+
+/* Heat diffusion split by rows between the GPU, which takes the rows
+ * below the split, and the CPU threads, which take the rest. Each side
+ * keeps a ghost row of the other one, exchanged every step through
+ * persistently mapped buffers ordered by fences, so the CPU computes its
+ * part while the GPU works on its own. The split moves so that both
+ * sides take the same time per step, measured with GPU timestamps
+ * around the commands of each step, so that the time the GPU waits for
+ * the CPU does not count, and with the CPU clock. Only the Euler integrator is supported. */
+class HybridSolver : public Solver {
+private:
+	/* steps between rebalancing */
+	static const int WINDOW = 64;
+	/* rows each side keeps at least */
+	static const int MIN_ROWS = 4;
+	
+	Programs programs;
+	gl::VertexBuffer buf;
+	gl::Sampler nearest{gl::Texture::NEAREST};
+	/* GPU rows and a ghost row above them holding the first CPU row */
+	gl::FrameBuffer fb[2];
+	/* [0] and [1] alternate between steps */
+	std::unique_ptr<gl::MappedBuffer> up[2], down[2];
+	int phase = 0;
+	
+	int sx = 0, sy = 0;
+	/* rows computed by the GPU */
+	int split = 0;
+	/* CPU rows with a ghost row below them holding the last GPU row */
+	Field2D temp, next, cond;
+	
+	/* the last GPU row is already in the CPU ghost row */
+	bool fresh = true;
+	
+	/* GPU timestamps before and after the commands of each step timed in
+	 * a call, read when available on one of the next calls */
+	std::vector<GLuint> stamps;
+	/* steps timed in the call not read yet */
+	int pending_steps = 0;
+	double pending_cpu = 0.0;
+	/* times and steps measured since the last rebalancing */
+	int window_steps = 0;
+	double gpu_time = 0.0, cpu_time = 0.0;
+	
+	HostView view;
+	Field2D host;
+	
+	static bool timers() {
+		return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	}
+	
+	int cpuRows() const {
+		return sy - split;
+	}
+	
+	/* CPU rows [r0, r1) of the Euler step, row 0 of the arrays is the ghost */
+	void cpuStep(int r0, int r1) {
+		float fdt = float(dt);
+		for(int r = r0; r < r1; ++r) {
+			int iy = r + 1;
+			const float *t = temp.row(0, iy);
+			const float *above = iy == cpuRows() ? t : temp.row(0, iy + 1);
+			eulerRow(t, temp.row(0, iy - 1), above, cond.row(0, iy), next.row(0, iy), sx, fdt);
+		}
+	}
+	
+	void cpuSteps() {
+		Bands::shared().run(cpuRows(), MIN_ROWS, [this](int, int r0, int r1) { cpuStep(r0, r1); });
+		std::swap(temp, next);
+	}
+	
+	/* one step, GPU commands between the begin and end timestamps if given,
+	 * returns the CPU time */
+	double stepOnce(GLuint begin, GLuint end) {
+		int p = phase, q = 1 - phase;
+		phase = q;
+		
+		/* the first CPU row becomes the ghost row of the GPU part */
+		up[p]->wait();
+		if(begin != 0)
+			glQueryCounter(begin, GL_TIMESTAMP);
+		float *u = static_cast<float *>(up[p]->data());
+		const float *t = temp.row(0, 1), *k = cond.row(0, 1);
+		for(int ix = 0; ix < sx; ++ix) {
+			u[2*ix + 0] = t[ix];
+			u[2*ix + 1] = k[ix];
+		}
+		fb[0].getTexture()->bind();
+		up[p]->bind();
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, split, sx, 1, GL_RG, GL_FLOAT, nullptr);
+		up[p]->unbind();
+		up[p]->fence();
+		
+		fb[1].bind();
+		programs["diffuse"]->setUniform("u_source", fb[0].getTexture(), &nearest);
+		programs["diffuse"]->evaluate();
+		std::swap(fb[0], fb[1]);
+		
+		/* the new last GPU row is picked up by the CPU on the next step */
+		down[p]->bind();
+		glReadPixels(0, split - 1, sx, 1, GL_RED, GL_FLOAT, nullptr);
+		down[p]->unbind();
+		down[p]->fence();
+		if(end != 0)
+			glQueryCounter(end, GL_TIMESTAMP);
+		glFlush();
+		
+		/* the last GPU row of this step, read back on the previous one */
+		if(!fresh) {
+			down[q]->wait();
+			const float *d = static_cast<const float *>(down[q]->data());
+			std::copy(d, d + sx, temp.row(0, 0));
+		}
+		fresh = false;
+		auto start = std::chrono::steady_clock::now();
+		cpuSteps();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	
+	/* takes the GPU time of the last timed steps if it is known by now */
+	void collectTimes() {
+		if(pending_steps == 0)
+			return;
+		/* the GPU writes the timestamps in order */
+		GLint available = 0;
+		glGetQueryObjectiv(stamps[2*pending_steps - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available)
+			return;
+		GLuint64 ns = 0;
+		for(int i = 0; i < pending_steps; ++i) {
+			GLuint64 t0 = 0, t1 = 0;
+			glGetQueryObjectui64v(stamps[2*i], GL_QUERY_RESULT, &t0);
+			glGetQueryObjectui64v(stamps[2*i + 1], GL_QUERY_RESULT, &t1);
+			ns += t1 - t0;
+		}
+		gpu_time += 1e-9*ns;
+		cpu_time += pending_cpu;
+		window_steps += pending_steps;
+		pending_steps = 0;
+		if(window_steps >= WINDOW)
+			balance();
+	}
+	
+	/* moves the split to even out the measured times of both sides */
+	void balance() {
+		/* rows per second of each side */
+		double gr = split/gpu_time, cr = cpuRows()/cpu_time;
+		fprintf(stderr, "Hybrid: GPU %.3f ms, CPU %.3f ms per step\n", 1e3*gpu_time/window_steps, 1e3*cpu_time/window_steps);
+		gpu_time = 0.0;
+		cpu_time = 0.0;
+		window_steps = 0;
+		if(!(gr > 0.0 && cr > 0.0))
+			return;
+		/* the slower side takes fewer rows, so a CPU-bound split grows the GPU part */
+		int target = int(sy*gr/(gr + cr));
+		target = std::max(MIN_ROWS, std::min(sy - MIN_ROWS, (split + target)/2));
+		if(std::abs(target - split) < std::max(2, sy/64))
+			return;
+		Field2D state;
+		readState(state);
+		setup(state, target);
+	}
+	
+	/* splits a full state at the given row */
+	void setup(const Field2D &state, int rows) {
+		split = rows;
+		int cr = cpuRows();
+		std::vector<float> data(4*sx*(split + 1), 0.0f);
+		for(int iy = 0; iy <= split; ++iy) {
+			const float *t = state.row(TEMP, iy), *k = state.row(COND, iy);
+			float *d = &data[4*iy*sx];
+			for(int ix = 0; ix < sx; ++ix) {
+				d[4*ix + 0] = t[ix];
+				d[4*ix + 1] = k[ix];
+				d[4*ix + 3] = 1.0f;
+			}
+		}
+		gl::Texture tex;
+		tex.loadData(data.data(), sx, split + 1, gl::Texture::RGBA, gl::Texture::FLOAT, gl::Texture::NEAREST);
+		for(gl::FrameBuffer &f : fb) {
+			f.setSize(sx, split + 1);
+		}
+		fb[0].bind();
+		programs["texture"]->setUniform("u_texture", &tex, &nearest);
+		programs["texture"]->evaluate();
+		gl::FrameBuffer::unbind();
+		int area_size_data[] = {sx, split + 1};
+		programs["diffuse"]->setUniform("u_area_size", area_size_data, 2);
+		
+		temp.resize(1, sx, cr + 1);
+		next.resize(1, sx, cr + 1);
+		cond.resize(1, sx, cr + 1);
+		for(int iy = 0; iy <= cr; ++iy) {
+			const float *t = state.row(TEMP, split - 1 + iy), *k = state.row(COND, split - 1 + iy);
+			std::copy(t, t + sx, temp.row(0, iy));
+			std::copy(k, k + sx, cond.row(0, iy));
+		}
+		
+		/* nothing in flight refers to the old split after this */
+		glFinish();
+		for(int i = 0; i < 2; ++i) {
+			up[i].reset(new gl::MappedBuffer(GL_PIXEL_UNPACK_BUFFER, 2*sizeof(float)*sx));
+			down[i].reset(new gl::MappedBuffer(GL_PIXEL_PACK_BUFFER, sizeof(float)*sx));
+		}
+		fresh = true;
+		/* steps timed before belong to the old split */
+		pending_steps = 0;
+		gpu_time = 0.0;
+		cpu_time = 0.0;
+		window_steps = 0;
+		fprintf(stderr, "Hybrid: GPU %d rows, CPU %d rows\n", split, cr);
+	}
+
+protected:
+	/* each side keeps MIN_ROWS rows, so smaller grids are refused */
+	void load(const Field2D &state) override {
+		int nx = state.width(), ny = state.height();
+		if(ny < 2*MIN_ROWS)
+			throw std::runtime_error("Hybrid grid must have at least " + std::to_string(2*MIN_ROWS) + " rows");
+		/* the split keeps its share of rows on resizing */
+		int rows = split > 0 ? split*ny/sy : ny/2;
+		sx = nx;
+		sy = ny;
+		setup(state, std::max(MIN_ROWS, std::min(ny - MIN_ROWS, rows)));
+	}
+
+public:
+	HybridSolver(Integrator integ = EULER, double step_dt = 0.1) : Solver(integ, step_dt), programs({
+		  Programs::ShaderInfo("position",  "position.vert",   gl::Shader::VERTEX),
+		  Programs::ShaderInfo("texture",   "texture.frag",    gl::Shader::FRAGMENT),
+		  Programs::ShaderInfo("diffuse",   "diffuse.frag",    gl::Shader::FRAGMENT)
+		}, {
+		  Programs::ProgramInfo("texture",   "position", "texture"),
+		  Programs::ProgramInfo("diffuse",   "position", "diffuse")
+		})
+	{
+		if(integ != EULER)
+			throw std::runtime_error("Hybrid backend supports the Euler integrator only");
+		if(!gl::MappedBuffer::supported())
+			throw std::runtime_error("Hybrid backend needs GL_ARB_buffer_storage");
+		
+		float vertex_data[] = {
+		  0, 0, 1, 0, 0, 1,
+		  0, 1, 1, 0, 1, 1
+		};
+		buf.loadData(vertex_data, 12);
+		
+		float map_data[]    = {2, 0, 0, 2};
+		float offset_data[] = {-1, -1};
+		
+		programs["texture"]->setAttribute("a_vertex", &buf);
+		programs["texture"]->setUniform("u_map", map_data, 4);
+		programs["texture"]->setUniform("u_offset", offset_data, 2);
+		
+		programs["diffuse"]->setAttribute("a_vertex", &buf);
+		programs["diffuse"]->setUniform("u_map", map_data, 4);
+		programs["diffuse"]->setUniform("u_offset", offset_data, 2);
+		programs["diffuse"]->setUniform("u_dt", float(dt));
+		
+		if(timers()) {
+			stamps.resize(2*WINDOW);
+			glGenQueries(GLsizei(stamps.size()), stamps.data());
+		}
+	}
+	~HybridSolver() {
+		if(!stamps.empty())
+			glDeleteQueries(GLsizei(stamps.size()), stamps.data());
+	}
+	
+	const char *name() const override {
+		return "hybrid";
+	}
+	int width() const override {
+		return sx;
+	}
+	int height() const override {
+		return sy;
+	}
+	/* grids the backend can not split keep the old size */
+	void resize(int nx, int ny) override {
+		if(ny < 2*MIN_ROWS) {
+			fprintf(stderr, "Hybrid grid must have at least %d rows\n", 2*MIN_ROWS);
+			return;
+		}
+		Solver::resize(nx, ny);
+	}
+	
+	/* rows currently computed on the GPU */
+	int gpuRows() const {
+		return split;
+	}
+	
+	void step(int n) override {
+		collectTimes();
+		/* the first steps of a call are timed if the timestamps are free */
+		int timed = stamps.empty() || pending_steps > 0 ? 0 : std::min(n, WINDOW);
+		double cpu = 0.0;
+		for(int i = 0; i < n; ++i) {
+			if(i < timed)
+				cpu += stepOnce(stamps[2*i], stamps[2*i + 1]);
+			else
+				stepOnce(0, 0);
+		}
+		if(timed > 0) {
+			pending_steps = timed;
+			pending_cpu = cpu;
+		}
+		gl::FrameBuffer::unbind();
+	}
+	
+	void readState(Field2D &state) override {
+		/* the GPU part is complete once the CPU part has taken its ghost row */
+		state.resize(2, sx, sy);
+		fb[0].readFloats(0, 0, sx, split, GL_RED, state.plane(TEMP), state.stride());
+		fb[0].readFloats(0, 0, sx, split, GL_GREEN, state.plane(COND), state.stride());
+		gl::FrameBuffer::unbind();
+		for(int iy = 1; iy <= cpuRows(); ++iy) {
+			std::copy(temp.row(0, iy), temp.row(0, iy) + sx, state.row(TEMP, split - 1 + iy));
+			std::copy(cond.row(0, iy), cond.row(0, iy) + sx, state.row(COND, split - 1 + iy));
+		}
+	}
+	
+	void copy(gl::FrameBuffer *dst) override {
+		readState(host);
+		view.draw(host, dst);
+	}
+};
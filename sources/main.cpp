@@ -1,11 +1,17 @@
 #include <cstdlib>
 #include <cstdio>
+#include <cmath>
+#include <algorithm>
 #include <functional>
 
 #include <SDL2/SDL.h>
 #include <GL/glew.h>
 
 #include "graphics.hpp"
+#include "exchange.hpp"
+#include "worker.hpp"
+#include "options.hpp"
+#include "tuner.hpp"
 
 class SDL {
 public:
@@ -57,6 +63,25 @@ public:
 	}
 };
 
+/* Context sharing objects with the given one, to be used by another thread */
+class SharedContext {
+public:
+	SDL_GLContext context;
+	SharedContext(const Context &c) {
+		SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+		context = SDL_GL_CreateContext(c.window);
+		SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+		if(context == NULL) {
+			fprintf(stderr, "Could not create shared SDL_GL_Context\n");
+			exit(1);
+		}
+		SDL_GL_MakeCurrent(c.window, c.context);
+	}
+	~SharedContext() {
+		SDL_GL_DeleteContext(context);
+	}
+};
+
 class GLEW {
 public:
 	GLEW() {
@@ -73,7 +98,31 @@ public:
 	~GLEW() = default;
 };
 
-int main(int, char *[]) {
+/* Part of the field shown in the window, center in field coordinates from 0 to 1 */
+struct View {
+	float x = 0.5f, y = 0.5f, zoom = 1.0f;
+	
+	/* keeps the visible part inside the field, at most a cell per window */
+	void clamp(int size) {
+		zoom = std::max(1.0f, std::min(zoom, float(size)));
+		float half = 0.5f/zoom;
+		x = std::max(half, std::min(x, 1.0f - half));
+		y = std::max(half, std::min(y, 1.0f - half));
+	}
+	/* zooms by factor keeping the point under window position u, v in place */
+	void zoomAt(float factor, float u, float v, int size) {
+		float fx = x + (u - 0.5f)/zoom, fy = y + (v - 0.5f)/zoom;
+		zoom *= factor;
+		clamp(size);
+		x = fx - (u - 0.5f)/zoom;
+		y = fy - (v - 0.5f)/zoom;
+		clamp(size);
+	}
+};
+
+int main(int argc, char *argv[]) {
+	Options opts = Options::parse(argc, argv);
+	Field2D::setPages(opts.pages);
 	SDL sdl;
 	int width = 800, height = 800;
 	Window window(
@@ -84,32 +133,96 @@ int main(int, char *[]) {
 	  SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE
 	);
 	Context context(window);
+	SharedContext shared(context);
 	GLEW glew;
+	if(opts.tune != Options::TUNE_OFF)
+		Tuner(opts.tune_cache).tune(opts, opts.tune == Options::TUNE_FORCE);
 	Graphics gfx;
 	gfx.resize(width, height);
 	
+	FrameExchange exchange;
+	Worker worker(window.window, shared.context, &exchange, opts);
+	
+	bool paused = false;
+	int steps = opts.steps;
+	int size = opts.size;
+	View view;
+	std::function<void()> sendView = [&]() {
+		view.clamp(size);
+		worker.send(Worker::Command(Worker::Command::VIEW, view.x, view.y, view.zoom));
+	};
 	bool done = false;
 	while(!done) {
+		/* the size changes once the worker has resized, which it may refuse */
+		int grid = worker.gridSize();
+		if(grid > 0 && grid != size) {
+			size = grid;
+			sendView();
+		}
 		SDL_Event event;
 		while(SDL_PollEvent(&event)) {
 			if(event.type == SDL_QUIT) {
 				done = true;
 			} else if(event.type == SDL_KEYDOWN) {
-				if(event.key.keysym.sym == SDLK_ESCAPE) {
+				switch(event.key.keysym.sym) {
+				case SDLK_ESCAPE:
 					done = true;
+					break;
+				case SDLK_SPACE:
+					paused = !paused;
+					worker.send(Worker::Command(Worker::Command::PAUSE, paused));
+					break;
+				case SDLK_s:
+					worker.send(Worker::Command(Worker::Command::STEP));
+					break;
+				case SDLK_EQUALS:
+				case SDLK_KP_PLUS:
+					steps *= 2;
+					worker.send(Worker::Command(Worker::Command::SET_STEPS, steps));
+					break;
+				case SDLK_MINUS:
+				case SDLK_KP_MINUS:
+					steps = steps > 1 ? steps/2 : 1;
+					worker.send(Worker::Command(Worker::Command::SET_STEPS, steps));
+					break;
+				case SDLK_LEFTBRACKET:
+					worker.send(Worker::Command(Worker::Command::RESIZE, size > 16 ? size/2 : size));
+					break;
+				case SDLK_RIGHTBRACKET:
+					worker.send(Worker::Command(Worker::Command::RESIZE, size < 8192 ? size*2 : size));
+					break;
+				case SDLK_0:
+				case SDLK_HOME:
+					view = View();
+					sendView();
+					break;
+				}
+			} else if(event.type == SDL_MOUSEWHEEL) {
+				int mx, my;
+				SDL_GetMouseState(&mx, &my);
+				view.zoomAt(std::pow(1.25f, float(event.wheel.y)), float(mx)/width, 1.0f - float(my)/height, size);
+				sendView();
+			} else if(event.type == SDL_MOUSEMOTION) {
+				if(event.motion.state & SDL_BUTTON_LMASK) {
+					view.x -= float(event.motion.xrel)/width/view.zoom;
+					view.y += float(event.motion.yrel)/height/view.zoom;
+					sendView();
 				}
 			} else if(event.type == SDL_WINDOWEVENT) {
 				if(event.window.event == SDL_WINDOWEVENT_RESIZED) {
-					gfx.resize(event.window.data1, event.window.data2);
+					width = event.window.data1;
+					height = event.window.data2;
+					gfx.resize(width, height);
 				}
 			}
 		}
 		
-		gfx.render();
+		gfx.render(exchange.acquireFront());
+		exchange.releaseFront();
 		context.swap();
 	}
 	
-	gfx.writeFile("out.txt");
+	worker.stop();
 	
 	return 0;
 }
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdio>
+
+#include <string>
+
+/* Publishes simulation health as JSON lines, rotated by size, and
+ * optionally as a Prometheus text file for the node exporter textfile
+ * collector, which is rewritten atomically on every sample. */
+class Metrics {
+private:
+	std::string path, prom_path;
+	long rotate_size;
+	FILE *file = nullptr;
+	long written = 0;
+	
+	bool has_prev = false;
+	long prev_step = 0;
+	double prev_time = 0.0;
+	bool has_initial = false;
+	double initial_heat = 0.0;
+	
+	void open() {
+		file = fopen(path.c_str(), "a");
+		if(file == nullptr) {
+			perror("error open metrics file");
+			return;
+		}
+		fseek(file, 0, SEEK_END);
+		written = ftell(file);
+	}
+	void rotate() {
+		fclose(file);
+		file = nullptr;
+		std::string old = path + ".1";
+		if(rename(path.c_str(), old.c_str()) != 0)
+			perror("error rotate metrics file");
+		open();
+	}
+	
+	void writeProm(long step, double rate, double heat, double drift, double min, double max) {
+		std::string tmp = prom_path + ".tmp";
+		FILE *f = fopen(tmp.c_str(), "w");
+		if(f == nullptr) {
+			perror("error write prometheus file");
+			return;
+		}
+		fprintf(f,
+		  "# HELP therm_steps_total Solver steps done.\n"
+		  "# TYPE therm_steps_total counter\n"
+		  "therm_steps_total %ld\n"
+		  "# HELP therm_steps_per_second Solver step rate.\n"
+		  "# TYPE therm_steps_per_second gauge\n"
+		  "therm_steps_per_second %g\n"
+		  "# HELP therm_heat_total Sum of the temperature field.\n"
+		  "# TYPE therm_heat_total gauge\n"
+		  "therm_heat_total %.9g\n"
+		  "# HELP therm_heat_drift Relative change of the total heat since start.\n"
+		  "# TYPE therm_heat_drift gauge\n"
+		  "therm_heat_drift %.9g\n"
+		  "# HELP therm_temperature_min Lowest temperature.\n"
+		  "# TYPE therm_temperature_min gauge\n"
+		  "therm_temperature_min %.9g\n"
+		  "# HELP therm_temperature_max Highest temperature.\n"
+		  "# TYPE therm_temperature_max gauge\n"
+		  "therm_temperature_max %.9g\n",
+		  step, rate, heat, drift, min, max
+		);
+		fclose(f);
+		if(rename(tmp.c_str(), prom_path.c_str()) != 0)
+			perror("error write prometheus file");
+	}
+
+public:
+	/* rotate_bytes <= 0 disables rotation, empty paths disable an output */
+	Metrics(const std::string &fn, const std::string &prom_fn, long rotate_bytes)
+	  : path(fn), prom_path(prom_fn), rotate_size(rotate_bytes)
+	{
+		if(!path.empty())
+			open();
+	}
+	~Metrics() {
+		if(file != nullptr)
+			fclose(file);
+	}
+	Metrics(const Metrics &) = delete;
+	Metrics &operator=(const Metrics &) = delete;
+	
+	/* time is the wall time in seconds at which the step was reached */
+	void publish(long step, double time, double heat, double min, double max) {
+		double rate = 0.0;
+		if(has_prev && time > prev_time)
+			rate = (step - prev_step)/(time - prev_time);
+		has_prev = true;
+		prev_step = step;
+		prev_time = time;
+		if(!has_initial) {
+			has_initial = true;
+			initial_heat = heat;
+		}
+		double drift = initial_heat != 0.0 ? (heat - initial_heat)/initial_heat : 0.0;
+		
+		if(file != nullptr) {
+			int n = fprintf(file,
+			  "{\"step\":%ld,\"time\":%.6f,\"steps_per_second\":%g,"
+			  "\"heat\":%.9g,\"heat_drift\":%.9g,\"min\":%.9g,\"max\":%.9g}\n",
+			  step, time, rate, heat, drift, min, max
+			);
+			fflush(file);
+			if(n > 0)
+				written += n;
+			if(rotate_size > 0 && written >= rotate_size)
+				rotate();
+		}
+		if(!prom_path.empty())
+			writeProm(step, rate, heat, drift, min, max);
+	}
+};
@@ -0,0 +1,441 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "solver.hpp"
+#include "hostview.hpp"
+#include "fieldfile.hpp"
+#include "bands.hpp"
+
+/* Heat diffusion on the CPU for grids larger than memory. The state stays
+ * in a field file and each pass streams it through memory in bands of
+ * rows. A band is read with a halo of up to fuse rows on both sides,
+ * advanced by as many Euler steps with the halo shrinking by a row per
+ * step, and its own rows are written back in place. An I/O thread reads
+ * the next band while the current one is computed. Reads and writes run
+ * in the order they were queued, so the read of a band always precedes
+ * the write of the band above, whose rows its halo covers. Stats and a
+ * preview for display are gathered as the bands pass by, so neither needs
+ * a pass of its own. Only the Euler integrator is supported. */
+class OOCSolver : public Solver {
+private:
+	/* preview cells along the longer side */
+	static const int PREVIEW = 1024;
+	/* seconds between I/O reports */
+	static const int REPORT = 5;
+	
+	struct Band {
+		/* rows [lo, hi) of the file are in memory, the band owns [y0, y1) */
+		int lo = 0, hi = 0, y0 = 0, y1 = 0;
+		/* temp[0] receives the read, the steps alternate between both */
+		Field2D temp[2], cond;
+		bool ready = false;
+	};
+	struct Job {
+		/* reads the rows of the band if set, writes rows [y0, y1) from src otherwise */
+		Band *band;
+		const float *src;
+		int y0, y1;
+	};
+	
+	FieldFile file;
+	std::string path;
+	int fuse;
+	size_t memory;
+	int sx = 0, sy = 0;
+	int band_rows = 0;
+	Band bands[2];
+	
+	std::mutex mutex;
+	std::condition_variable cv_jobs, cv_done;
+	std::deque<Job> jobs;
+	bool closing = false;
+	std::string io_error;
+	std::thread io;
+	
+	/* since the last report, the I/O ones are written by the I/O thread */
+	uint64_t bytes_read = 0, bytes_written = 0;
+	double io_time = 0.0, compute_time = 0.0, wait_time = 0.0;
+	long report_steps = 0;
+	std::chrono::steady_clock::time_point report_start;
+	
+	/* of the field at the end of the last pass */
+	Stats stats;
+	/* summed in double, the grid may have billions of cells */
+	double heat = 0.0;
+	Field2D preview, preview_sum;
+	int preview_factor = 1;
+	
+	HostView view;
+	
+	static double seconds(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	
+	void ioLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			cv_jobs.wait(lock, [this]() { return closing || !jobs.empty(); });
+			if(jobs.empty())
+				return;
+			Job job = jobs.front();
+			lock.unlock();
+			
+			auto start = std::chrono::steady_clock::now();
+			size_t bytes = 0;
+			std::string error;
+			try {
+				if(job.band == nullptr) {
+					file.writeRows(TEMP, job.y0, job.y1, job.src);
+					bytes = file.rowBytes()*(job.y1 - job.y0);
+				} else {
+					Band &b = *job.band;
+					file.readRows(TEMP, b.lo, b.hi, b.temp[0].plane(0));
+					file.readRows(COND, b.lo, b.hi, b.cond.plane(0));
+					bytes = 2*file.rowBytes()*(b.hi - b.lo);
+				}
+			} catch(const std::exception &e) {
+				error = e.what();
+			}
+			double t = seconds(start);
+			
+			lock.lock();
+			/* popped only now, so that no jobs means nothing in flight */
+			jobs.pop_front();
+			io_time += t;
+			if(job.band == nullptr) {
+				bytes_written += bytes;
+			} else {
+				bytes_read += bytes;
+				job.band->ready = true;
+			}
+			if(!error.empty() && io_error.empty())
+				io_error = error;
+			cv_done.notify_all();
+		}
+	}
+	
+	void queue(const Job &job) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(job);
+		}
+		cv_jobs.notify_one();
+	}
+	void queueRead(Band &b, int index, int steps) {
+		b.y0 = index*band_rows;
+		b.y1 = std::min(b.y0 + band_rows, sy);
+		b.lo = std::max(b.y0 - steps, 0);
+		b.hi = std::min(b.y1 + steps, sy);
+		b.ready = false;
+		queue(Job{&b, nullptr, 0, 0});
+	}
+	void waitReady(Band &b) {
+		auto start = std::chrono::steady_clock::now();
+		std::unique_lock<std::mutex> lock(mutex);
+		cv_done.wait(lock, [&]() { return b.ready || !io_error.empty(); });
+		wait_time += seconds(start);
+		if(!io_error.empty())
+			throw std::runtime_error(io_error);
+	}
+	/* waits until the file holds the current state */
+	void sync() {
+		std::unique_lock<std::mutex> lock(mutex);
+		cv_done.wait(lock, [this]() { return jobs.empty(); });
+		if(!io_error.empty())
+			throw std::runtime_error(io_error);
+	}
+	
+	/* file rows [r0, r1) of an Euler step from temp[cur] to temp[1 - cur] */
+	void stepRows(Band &b, int cur, int r0, int r1) {
+		float fdt = float(dt);
+		const Field2D &src = b.temp[cur];
+		Field2D &dst = b.temp[1 - cur];
+		for(int y = r0; y < r1; ++y) {
+			const float *t = src.row(0, y - b.lo);
+			const float *below = y > 0 ? src.row(0, y - 1 - b.lo) : t;
+			const float *above = y < sy - 1 ? src.row(0, y + 1 - b.lo) : t;
+			eulerRow(t, below, above, b.cond.row(0, y - b.lo), dst.row(0, y - b.lo), sx, fdt);
+		}
+	}
+	
+	/* steps the band, returns the temp holding the result */
+	int compute(Band &b, int steps) {
+		int cur = 0;
+		for(int s = 1; s <= steps; ++s) {
+			/* rows next to the halo edge lack a neighbour, the grid edges do not */
+			int r0 = b.lo == 0 ? 0 : b.lo + s;
+			int r1 = b.hi == sy ? sy : b.hi - s;
+			Bands::shared().run(r1 - r0, 4, [&](int, int y0, int y1) { stepRows(b, cur, r0 + y0, r0 + y1); });
+			cur = 1 - cur;
+		}
+		return cur;
+	}
+	
+	void beginGather() {
+		stats = Stats{0.0f, 1e30f, -1e30f};
+		heat = 0.0;
+		preview_sum.fill(TEMP, 0.0f);
+		preview_sum.fill(COND, 0.0f);
+	}
+	/* rows [y0, y1) of the new state, consecutive rows from t and k */
+	void gather(const float *t, const float *k, int y0, int y1) {
+		int stride = Field2D::strideOf(sx);
+		for(int y = y0; y < y1; ++y) {
+			const float *tr = t + size_t(y - y0)*stride, *kr = k + size_t(y - y0)*stride;
+			float *pt = preview_sum.row(TEMP, y/preview_factor), *pk = preview_sum.row(COND, y/preview_factor);
+			double row_heat = 0.0;
+			for(int ix = 0; ix < sx; ++ix) {
+				row_heat += tr[ix];
+				stats.min = std::min(stats.min, tr[ix]);
+				stats.max = std::max(stats.max, tr[ix]);
+				pt[ix/preview_factor] += tr[ix];
+				pk[ix/preview_factor] += kr[ix];
+			}
+			heat += row_heat;
+		}
+	}
+	void endGather() {
+		stats.sum = float(heat);
+		int f = preview_factor;
+		for(int py = 0; py < preview.height(); ++py) {
+			int ny = std::min(f, sy - py*f);
+			for(int px = 0; px < preview.width(); ++px) {
+				float n = float(std::min(f, sx - px*f)*ny);
+				preview.at(TEMP, px, py) = preview_sum.at(TEMP, px, py)/n;
+				preview.at(COND, px, py) = preview_sum.at(COND, px, py)/n;
+			}
+		}
+	}
+	
+	/* one sweep over the file advancing it by steps, at most fuse */
+	void pass(int steps) {
+		int count = (sy + band_rows - 1)/band_rows;
+		queueRead(bands[0], 0, steps);
+		if(count > 1)
+			queueRead(bands[1], 1, steps);
+		beginGather();
+		for(int i = 0; i < count; ++i) {
+			Band &b = bands[i % 2];
+			waitReady(b);
+			auto start = std::chrono::steady_clock::now();
+			int cur = compute(b, steps);
+			gather(b.temp[cur].row(0, b.y0 - b.lo), b.cond.row(0, b.y0 - b.lo), b.y0, b.y1);
+			compute_time += seconds(start);
+			/* the band may be queued for another read before this is written */
+			queue(Job{nullptr, b.temp[cur].row(0, b.y0 - b.lo), b.y0, b.y1});
+			/* after the write above, before the one of band i + 1 */
+			if(i + 2 < count)
+				queueRead(b, i + 2, steps);
+		}
+		endGather();
+	}
+	
+	void report() {
+		double elapsed = seconds(report_start);
+		if(elapsed < REPORT || report_steps == 0)
+			return;
+		uint64_t rd, wr;
+		double io_t;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			rd = bytes_read;
+			wr = bytes_written;
+			io_t = io_time;
+			bytes_read = 0;
+			bytes_written = 0;
+			io_time = 0.0;
+		}
+		double per = 1.0/report_steps;
+		fprintf(stderr,
+		  "OOC: per step %.1f MiB read, %.1f MiB written, %.2f ms I/O, %.2f ms compute, %.2f ms stalled on reads\n",
+		  per*rd/(1 << 20), per*wr/(1 << 20), 1e3*per*io_t, 1e3*per*compute_time, 1e3*per*wait_time
+		);
+		compute_time = 0.0;
+		wait_time = 0.0;
+		report_steps = 0;
+		report_start = std::chrono::steady_clock::now();
+	}
+	
+	/* a new file and buffers for a nx*ny grid */
+	void setup(int nx, int ny) {
+		sync();
+		sx = nx;
+		sy = ny;
+		file.create(path, 2, sx, sy);
+		
+		/* two bands of three planes each with their halos */
+		size_t row_bytes = file.rowBytes();
+		long rows = long(memory/(6*row_bytes)) - 2*fuse;
+		band_rows = int(std::max(long(fuse), std::min(rows, long(sy))));
+		band_rows = std::max(band_rows, 1);
+		for(Band &b : bands) {
+			b.temp[0].resize(1, sx, band_rows + 2*fuse);
+			b.temp[1].resize(1, sx, band_rows + 2*fuse);
+			b.cond.resize(1, sx, band_rows + 2*fuse);
+		}
+		
+		preview_factor = (std::max(sx, sy) + PREVIEW - 1)/PREVIEW;
+		int pw = (sx + preview_factor - 1)/preview_factor, ph = (sy + preview_factor - 1)/preview_factor;
+		preview.resize(2, pw, ph);
+		preview_sum.resize(2, pw, ph);
+		fprintf(stderr, "OOC: %d bands of %d rows, %d steps per pass\n", (sy + band_rows - 1)/band_rows, band_rows, fuse);
+	}
+
+protected:
+	void load(const Field2D &state) override {
+		setup(state.width(), state.height());
+		file.writeRows(TEMP, 0, sy, state.plane(TEMP));
+		file.writeRows(COND, 0, sy, state.plane(COND));
+		beginGather();
+		gather(state.plane(TEMP), state.plane(COND), 0, sy);
+		endGather();
+	}
+
+public:
+	/* fuse steps share a pass over the file, bands take about memory bytes;
+	 * an empty file name keeps the field in an unlinked temporary file */
+	OOCSolver(Integrator integ, double step_dt, const std::string &fn, int steps_per_pass, size_t memory_bytes)
+	  : Solver(integ, step_dt), path(fn), fuse(std::max(1, steps_per_pass)), memory(memory_bytes)
+	{
+		if(integ != EULER)
+			throw std::runtime_error("OOC backend supports the Euler integrator only");
+		report_start = std::chrono::steady_clock::now();
+		io = std::thread(&OOCSolver::ioLoop, this);
+	}
+	~OOCSolver() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closing = true;
+		}
+		cv_jobs.notify_all();
+		io.join();
+	}
+	
+	/* writes the initial state band by band, so the grid never is in memory as a whole */
+	void start(int nx, int ny) override {
+		setup(nx, ny);
+		Field2D rows(2, sx, band_rows);
+		float k_max = 0.0f;
+		beginGather();
+		for(int y0 = 0; y0 < sy; y0 += band_rows) {
+			int y1 = std::min(y0 + band_rows, sy);
+			for(int iy = y0; iy < y1; ++iy) {
+				float *t = rows.row(TEMP, iy - y0), *k = rows.row(COND, iy - y0);
+				for(int ix = 0; ix < sx; ++ix) {
+					initialCell(double(ix)/sx, double(iy)/sy, t[ix], k[ix]);
+					k_max = std::max(k_max, k[ix]);
+				}
+			}
+			file.writeRows(TEMP, y0, y1, rows.plane(TEMP));
+			file.writeRows(COND, y0, y1, rows.plane(COND));
+			gather(rows.plane(TEMP), rows.plane(COND), y0, y1);
+		}
+		endGather();
+		setupIntegrator(k_max);
+	}
+	
+	const char *name() const override {
+		return "ooc";
+	}
+	int width() const override {
+		return sx;
+	}
+	int height() const override {
+		return sy;
+	}
+	
+	void step(int n) override {
+		while(n > 0) {
+			int s = std::min(n, fuse);
+			pass(s);
+			n -= s;
+			report_steps += s;
+		}
+		report();
+	}
+	
+	/* needs the whole grid in memory, unlike stepping */
+	void readState(Field2D &state) override {
+		sync();
+		state.resize(2, sx, sy);
+		file.readRows(TEMP, 0, sy, state.plane(TEMP));
+		file.readRows(COND, 0, sy, state.plane(COND));
+	}
+	void readField(Field2D &data) override {
+		sync();
+		data.resize(1, sx, sy);
+		file.readRows(TEMP, 0, sy, data.plane(0));
+	}
+	/* streams the file a block row at a time */
+	void readField(Field2D &data, int factor, Reduction mode) override {
+		if(factor <= 1) {
+			readField(data);
+			return;
+		}
+		sync();
+		int w = (sx + factor - 1)/factor;
+		int h = (sy + factor - 1)/factor;
+		data.resize(1, w, h);
+		Field2D block(1, sx, factor);
+		for(int ty = 0; ty < h; ++ty) {
+			int by = ty*factor, rows = std::min(factor, sy - by);
+			file.readRows(TEMP, by, by + rows, block.plane(0));
+			for(int tx = 0; tx < w; ++tx) {
+				int bx = tx*factor;
+				float v = block.at(0, bx, 0);
+				if(mode != POINT) {
+					float sum = 0.0f, lo = v, hi = v;
+					int n = 0;
+					for(int iy = 0; iy < rows; ++iy) {
+						for(int ix = bx; ix < std::min(bx + factor, sx); ++ix) {
+							float s = block.at(0, ix, iy);
+							sum += s;
+							lo = std::min(lo, s);
+							hi = std::max(hi, s);
+							n += 1;
+						}
+					}
+					v = mode == BOX ? sum/n : mode == MIN ? lo : hi;
+				}
+				data.at(0, tx, ty) = v;
+			}
+		}
+	}
+	
+	/* a read of a single cell per probe */
+	void sampleProbes(long step) override {
+		if(probes.empty())
+			return;
+		sync();
+		std::vector<float> values(probes.size());
+		for(size_t i = 0; i < probes.size(); ++i) {
+			int ix, iy;
+			probeCell(probes[i], sx, sy, ix, iy);
+			values[i] = file.readCell(TEMP, ix, iy);
+		}
+		pushProbes(step, std::move(values));
+	}
+	
+	/* gathered by the last pass */
+	bool requestStats(long tag) override {
+		return pushStats(tag, stats);
+	}
+	
+	/* the preview is box averaged down to PREVIEW cells along the longer side */
+	void copy(gl::FrameBuffer *dst) override {
+		view.draw(preview, dst);
+	}
+};
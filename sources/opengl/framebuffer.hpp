@@ -1,32 +1,67 @@
 #pragma once
 
+#include <utility>
+
 #include <GL/glew.h>
 
 #include "texture.hpp"
 #include "exception.hpp"
+#include "state.hpp"
 
 namespace gl {
 class FrameBuffer {
 private:
-	GLuint _id;
+	GLuint _id = 0;
 	Texture _tex;
-	int _width, _height;
+	int _width = 0, _height = 0;
 	
-public:
-	FrameBuffer() throw(Exception) {
-		glGenFramebuffers(1, &_id);
+	void _take(FrameBuffer &fb) {
+		_id = fb._id;
+		_tex = std::move(fb._tex);
+		_width = fb._width;
+		_height = fb._height;
+		fb._id = 0;
+		fb._width = 0;
+		fb._height = 0;
 	}
+	void _release() {
+		if(_id != 0) {
+			State::current().forgetFramebuffer(_id);
+			glDeleteFramebuffers(1, &_id);
+			_id = 0;
+		}
+	}
+	
+public:
+	/* the GL framebuffer is created on the first setSize,
+	 * so an empty one may be constructed without a current context */
+	FrameBuffer() = default;
 	virtual ~FrameBuffer() {
-		glDeleteFramebuffers(1, &_id);
+		_release();
+	}
+	FrameBuffer(const FrameBuffer &) = delete;
+	FrameBuffer &operator=(const FrameBuffer &) = delete;
+	FrameBuffer(FrameBuffer &&fb) {
+		_take(fb);
+	}
+	FrameBuffer &operator=(FrameBuffer &&fb) {
+		if(this != &fb) {
+			_release();
+			_take(fb);
+		}
+		return *this;
 	}
 	
-	void setSize(int width, int height) throw(Exception) {
+	void setSize(int width, int height, Texture::Format format = Texture::RGBA, Texture::Type type = Texture::FLOAT) throw(Exception) {
+		if(_id == 0)
+			glGenFramebuffers(1, &_id);
+		
 		_width = width;
 		_height = height;
 		
 		bind();
 		
-		_tex.loadData(nullptr, width, height, Texture::RGBA, Texture::FLOAT);
+		_tex.loadData(nullptr, width, height, format, type);
 		
 		if(GLEW_VERSION_3_2)
 			glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, _tex.id(), 0);
@@ -43,16 +78,31 @@ public:
 	}
 	
 	void bind() {
-		glBindFramebuffer(GL_FRAMEBUFFER, _id);
-		glViewport(0, 0, _width, _height);
+		State &st = State::current();
+		st.bindFramebuffer(_id);
+		st.viewport(0, 0, _width, _height);
 	}
 	static void unbind() {
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		State::current().bindFramebuffer(0);
+	}
+	
+	/* reads one float channel, like GL_RED, into rows row_length floats apart */
+	void readFloats(int x, int y, int w, int h, GLenum format, float *data, int row_length) {
+		bind();
+		glPixelStorei(GL_PACK_ROW_LENGTH, row_length);
+		glReadPixels(x, y, w, h, format, GL_FLOAT, data);
+		glPixelStorei(GL_PACK_ROW_LENGTH, 0);
 	}
 	
 	GLuint id() const {
 		return _id;
 	}
+	int width() const {
+		return _width;
+	}
+	int height() const {
+		return _height;
+	}
 	const Texture *getTexture() const {
 		return &_tex;
 	}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "exception.hpp"
+
+namespace gl {
+/* Buffer mapped for its whole lifetime (GL_ARB_buffer_storage), so the
+ * host reads or writes it in place while the GPU transfers from or to it.
+ * Instead of map and unmap calls the accesses are ordered by a fence set
+ * after the GPU commands using the buffer. */
+class MappedBuffer {
+private:
+	GLuint _id = 0;
+	GLenum _target;
+	long _size;
+	void *_data = nullptr;
+	GLsync _fence = nullptr;
+
+public:
+	static bool supported() {
+		return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+	}
+	
+	/* GL_PIXEL_PACK_BUFFER is mapped for reading, any other target for writing */
+	MappedBuffer(GLenum target, long size) : _target(target), _size(size) {
+		if(!supported())
+			throw Exception("No persistent mapping support : (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) == 0");
+		GLbitfield access = target == GL_PIXEL_PACK_BUFFER ? GL_MAP_READ_BIT : GL_MAP_WRITE_BIT;
+		GLbitfield flags = access | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glGenBuffers(1, &_id);
+		glBindBuffer(_target, _id);
+		glBufferStorage(_target, size, nullptr, flags);
+		_data = glMapBufferRange(_target, 0, size, flags);
+		glBindBuffer(_target, 0);
+		if(_data == nullptr)
+			throw Exception("MappedBuffer map error");
+	}
+	~MappedBuffer() {
+		if(_fence != nullptr)
+			glDeleteSync(_fence);
+		glBindBuffer(_target, _id);
+		glUnmapBuffer(_target);
+		glBindBuffer(_target, 0);
+		glDeleteBuffers(1, &_id);
+	}
+	MappedBuffer(const MappedBuffer &) = delete;
+	MappedBuffer &operator=(const MappedBuffer &) = delete;
+	
+	void bind() const {
+		glBindBuffer(_target, _id);
+	}
+	void unbind() const {
+		glBindBuffer(_target, 0);
+	}
+	
+	/* to be called after the GPU commands reading or writing the buffer */
+	void fence() {
+		if(_fence != nullptr)
+			glDeleteSync(_fence);
+		_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	/* blocks until the commands before the last fence are done,
+	 * the host may touch the data afterwards */
+	void wait() {
+		if(_fence == nullptr)
+			return;
+		while(glClientWaitSync(_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+		glDeleteSync(_fence);
+		_fence = nullptr;
+	}
+	
+	void *data() {
+		return _data;
+	}
+	long size() const {
+		return _size;
+	}
+};
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstring>
+
+#include <GL/glew.h>
+
+namespace gl {
+/* Buffer receiving framebuffer pixels asynchronously, the transfer
+ * completes in the background and is polled for instead of waited on. */
+class PixelBuffer {
+private:
+	GLuint _id = 0;
+	long _size = 0;
+	GLsync _fence = nullptr;
+	bool _pending = false;
+	
+	static bool fences() {
+		return GLEW_VERSION_3_2 || GLEW_ARB_sync;
+	}
+
+public:
+	PixelBuffer(long size) : _size(size) {
+		glGenBuffers(1, &_id);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, _id);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+	~PixelBuffer() {
+		if(_fence != nullptr)
+			glDeleteSync(_fence);
+		glDeleteBuffers(1, &_id);
+	}
+	PixelBuffer(const PixelBuffer &) = delete;
+	PixelBuffer &operator=(const PixelBuffer &) = delete;
+	
+	/* starts reading a region of the bound framebuffer */
+	void read(int x, int y, int w, int h, GLenum format, GLenum type) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, _id);
+		glReadPixels(x, y, w, h, format, type, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		if(fences()) {
+			if(_fence != nullptr)
+				glDeleteSync(_fence);
+			_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+		_pending = true;
+	}
+	
+	bool pending() const {
+		return _pending;
+	}
+	/* the transfer is done and fetch will not stall */
+	bool ready() {
+		if(!_pending)
+			return false;
+		if(_fence == nullptr)
+			return true;
+		GLenum r = glClientWaitSync(_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		return r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED;
+	}
+	/* copies size bytes of the result and frees the buffer for the next read */
+	void fetch(void *dst, long size) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, _id);
+		const void *src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+		if(src != nullptr) {
+			memcpy(dst, src, size);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		if(_fence != nullptr) {
+			glDeleteSync(_fence);
+			_fence = nullptr;
+		}
+		_pending = false;
+	}
+	
+	GLuint id() const {
+		return _id;
+	}
+	long size() const {
+		return _size;
+	}
+};
+}
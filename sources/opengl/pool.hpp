@@ -0,0 +1,61 @@
+#pragma once
+
+#include <map>
+#include <tuple>
+#include <utility>
+
+#include "framebuffer.hpp"
+#include "texture.hpp"
+
+namespace gl {
+/* Keeps released framebuffers for reuse by size and format, so that
+ * reallocating pass targets, e.g. on resize, does not churn GPU memory. */
+class FrameBufferPool {
+private:
+	struct Key {
+		int width, height;
+		Texture::Format format;
+		Texture::Type type;
+		bool operator<(const Key &k) const {
+			return std::tie(width, height, format, type) < std::tie(k.width, k.height, k.format, k.type);
+		}
+	};
+	std::multimap<Key, FrameBuffer> _free;
+	size_t _limit;
+
+public:
+	/* at most limit framebuffers are kept, others are destroyed on release */
+	FrameBufferPool(size_t limit = 16) : _limit(limit) {}
+	FrameBufferPool(const FrameBufferPool &) = delete;
+	FrameBufferPool &operator=(const FrameBufferPool &) = delete;
+	
+	FrameBuffer acquire(int width, int height, Texture::Format format = Texture::RGBA, Texture::Type type = Texture::FLOAT) {
+		Key key = {width, height, format, type};
+		auto iter = _free.find(key);
+		if(iter != _free.end()) {
+			FrameBuffer fb(std::move(iter->second));
+			_free.erase(iter);
+			return fb;
+		}
+		FrameBuffer fb;
+		fb.setSize(width, height, format, type);
+		return fb;
+	}
+	void release(FrameBuffer &&fb) {
+		if(fb.id() == 0)
+			return;
+		if(_free.size() >= _limit)
+			_free.erase(_free.begin());
+		const Texture *t = fb.getTexture();
+		Key key = {fb.width(), fb.height(), t->format(), t->type()};
+		_free.insert(std::make_pair(key, std::move(fb)));
+	}
+	
+	void clear() {
+		_free.clear();
+	}
+	size_t size() const {
+		return _free.size();
+	}
+};
+}
@@ -2,6 +2,7 @@
 
 #include <cstring>
 
+#include <algorithm>
 #include <list>
 #include <map>
 #include <string>
@@ -11,7 +12,9 @@
 #include "exception.hpp"
 #include "shader.hpp"
 #include "texture.hpp"
+#include "sampler.hpp"
 #include "vertexbuffer.hpp"
+#include "state.hpp"
 
 namespace gl {
 class Program {
@@ -37,7 +40,10 @@ public:
 			int     idata[16];
 		};
 		const Texture *tex = nullptr;
+		const Sampler *sampler = nullptr;
 		int texno = 0;
+		/* value differs from the one stored in the program object */
+		bool dirty = true;
 	};
 private:
 	GLuint _id;
@@ -45,11 +51,13 @@ private:
 	std::list<Shader*> _shaders;
 	std::map<std::string, AttribVariable> _attribs;
 	std::map<std::string, UniformVariable> _uniforms;
+	State::Blend _blend = State::REPLACE;
 public:
 	Program() {
 		_id = glCreateProgram();
 	}
 	~Program() {
+		State::current().forgetProgram(_id);
 		for(Shader *s : _shaders) {
 			glDetachShader(_id, s->id());
 		}
@@ -78,10 +86,10 @@ public:
 	}
 
 	void enable() {
-		glUseProgram(_id);
+		State::current().useProgram(_id);
 	}
 	static void disable() {
-		glUseProgram(0);
+		State::current().useProgram(0);
 	}
 	
 	GLuint id() const {
@@ -167,6 +175,7 @@ private:
 			if(loc == -1)
 				throw Exception("Uniform '" + i->first + "' location error");
 			i->second.id = loc;
+			i->second.dirty = true;
 		}
 	}
 
@@ -179,13 +188,23 @@ public:
 	}
 	
 private:
-	void _loadUniform(const UniformVariable &var) {
-		if(var.kind == Variable::SAMPLER && var.tex != nullptr) {
-			glActiveTexture(GL_TEXTURE0 + var.texno);
-			glUniform1i(var.id, var.texno);
-			var.tex->bind();
+	void _loadUniform(UniformVariable &var) {
+		if(var.kind == Variable::SAMPLER) {
+			if(var.tex == nullptr)
+				return;
+			State::current().bindTexture(var.texno, var.tex->id());
+			if(var.sampler != nullptr)
+				var.sampler->bind(var.texno, var.tex);
+			else
+				Sampler::unbind(var.texno);
+			if(var.dirty)
+				glUniform1i(var.id, var.texno);
+			var.dirty = false;
 			return;
 		}
+		if(!var.dirty)
+			return;
+		var.dirty = false;
 		switch(var.type) {
 		case FLOAT:
 			switch(var.kind) {
@@ -252,21 +271,24 @@ public:
 	void evaluate() {
 		enable();
 		
-		for(const auto &p : _uniforms) {
-			UniformVariable var = p.second;
-			_loadUniform(var);
+		for(auto &p : _uniforms) {
+			_loadUniform(p.second);
 		}
 		
+		State &st = State::current();
+		unsigned mask = 0;
 		for(const auto &p : _attribs) {
-			Variable var = p.second;
-			glEnableVertexAttribArray(var.id);
+			mask |= 1u << p.second.id;
 		}
+		st.setAttribArrays(mask);
 		
+		/* instances as many as the shortest per instance buffer has values for */
+		long instances = -1;
 		for(const auto &p : _attribs) {
-			AttribVariable var = p.second;
+			const AttribVariable &var = p.second;
 			VertexBuffer *buffer = var.buffer;
 			if(buffer != nullptr) {
-				GLuint glt;
+				GLenum glt;
 				switch(var.type) {
 				case FLOAT:
 					glt = GL_FLOAT;
@@ -275,26 +297,40 @@ public:
 					glt = GL_INT;
 					break;
 				}
-				buffer->bind();
-				glVertexAttribPointer(var.id, var.dim, glt, GL_FALSE, 0, NULL);
-				buffer->unbind();
+				st.attribPointer(var.id, buffer->id(), var.dim, glt);
+				st.attribDivisor(var.id, buffer->divisor());
+				if(buffer->divisor() > 0) {
+					long n = buffer->size()/var.dim*buffer->divisor();
+					instances = instances < 0 ? n : std::min(instances, n);
+				}
 			}
 		}
+		st.blend(_blend);
 		
+		if(instances >= 0) {
+			/* a single draw of the per vertex buffer covers all instances */
+			if(instances == 0)
+				return;
+			for(const auto &p : _attribs) {
+				VertexBuffer *buffer = p.second.buffer;
+				if(buffer != nullptr && buffer->divisor() == 0) {
+					buffer->drawInstanced(buffer->size()/p.second.dim, instances);
+					return;
+				}
+			}
+			return;
+		}
 		for(const auto &p : _attribs) {
-			AttribVariable var = p.second;
-			VertexBuffer *buffer = var.buffer;
+			VertexBuffer *buffer = p.second.buffer;
 			if(buffer != nullptr) {
 				buffer->draw();
 			}
 		}
-		
-		for(const auto &p : _attribs) {
-			AttribVariable var = p.second;
-			glDisableVertexAttribArray(var.id);
-		}
-		
-		disable();
+	}
+	
+	/* how fragments of the next evaluations combine with the target */
+	void setBlend(State::Blend mode) {
+		_blend = mode;
 	}
 	
 	void setAttribute(const std::string &name, VertexBuffer *buf) {
@@ -334,10 +370,16 @@ public:
 			throw Exception("Uniform '" + name + "' type mismatch");
 		switch(var.type) {
 		case INT:
-			memcpy(var.idata, data, sizeof(int)*len);
+			if(memcmp(var.idata, data, sizeof(int)*len) != 0) {
+				memcpy(var.idata, data, sizeof(int)*len);
+				var.dirty = true;
+			}
 			break;
 		case FLOAT:
-			memcpy(var.fdata, data, sizeof(float)*len);
+			if(memcmp(var.fdata, data, sizeof(float)*len) != 0) {
+				memcpy(var.fdata, data, sizeof(float)*len);
+				var.dirty = true;
+			}
 			break;
 		}
 	}
@@ -346,7 +388,7 @@ public:
 	typename std::enable_if<std::is_arithmetic<T>::value, void>::type setUniform(const std::string &name, T data) {
 		setUniform(name, &data, 1);
 	}
-	void setUniform(const std::string &name, const Texture *tex) {
+	void setUniform(const std::string &name, const Texture *tex, const Sampler *sampler = nullptr) {
 		auto iter = _uniforms.find(name);
 		if(iter == _uniforms.end())
 			throw Exception("No such uniform '" + name + "'");
@@ -354,6 +396,7 @@ public:
 		if(var.kind != Variable::SAMPLER)
 			throw Exception("Uniform '" + name + "' is not sampler");
 		var.tex = tex;
+		var.sampler = sampler;
 	}
 };
 }
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "texture.hpp"
+#include "state.hpp"
+
+namespace gl {
+/* Filtering state attached to a texture unit instead of the texture itself.
+ * Without sampler objects support the interpolation is applied to the texture
+ * on binding, which Texture elides when it is already set. */
+class Sampler {
+private:
+	GLuint _id = 0;
+	Texture::Interpolation _inp;
+
+public:
+	static bool supported() {
+		return GLEW_VERSION_3_3 || GLEW_ARB_sampler_objects;
+	}
+
+	Sampler(Texture::Interpolation inp = Texture::NEAREST) : _inp(inp) {
+		if(!supported())
+			return;
+		glGenSamplers(1, &_id);
+		glSamplerParameteri(_id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glSamplerParameteri(_id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glSamplerParameteri(_id, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		switch(inp) {
+		case Texture::LINEAR:
+			glSamplerParameteri(_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			break;
+		case Texture::NEAREST:
+			glSamplerParameteri(_id, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			break;
+		}
+	}
+	~Sampler() {
+		if(_id != 0) {
+			State::current().forgetSampler(_id);
+			glDeleteSamplers(1, &_id);
+		}
+	}
+	Sampler(const Sampler &) = delete;
+	Sampler &operator=(const Sampler &) = delete;
+
+	void bind(int unit, const Texture *tex) const {
+		if(_id != 0)
+			State::current().bindSampler(unit, _id);
+		else {
+			State::current().activeTexture(unit);
+			tex->setInterpolation(_inp);
+		}
+	}
+	static void unbind(int unit) {
+		if(supported())
+			State::current().bindSampler(unit, 0);
+	}
+
+	GLuint id() const {
+		return _id;
+	}
+	Texture::Interpolation interpolation() const {
+		return _inp;
+	}
+};
+}
@@ -46,7 +46,7 @@ public:
 		glDeleteShader(_id);
 	}
 	
-	void loadSource(char *source, long size) {
+	void loadSource(const char *source, long size) {
 		glShaderSource(_id, 1, &source, nullptr);
 		_findVariables(source, size);
 	}
@@ -104,7 +104,7 @@ public:
 	}
 	
 private:
-	void _findVariables(char *source, long) {
+	void _findVariables(const char *source, long) {
 		std::string string;
 		std::smatch match;
 		std::regex expr;
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <GL/glew.h>
+
+namespace gl {
+/* Shadow copy of the GL binding state of the current context.
+ * Every bind in the wrappers goes through it, so calls that would
+ * not change anything are not issued to the driver at all.
+ * There is one instance per thread, each thread owns at most one context. */
+class State {
+public:
+	static const int MAX_UNITS = 16;
+	static const int MAX_ATTRIBS = 16;
+	static const GLuint UNKNOWN = ~GLuint(0);
+
+	struct AttribPointer {
+		GLuint buffer = 0;
+		int dim = 0;
+		GLenum type = 0;
+		/* instances sharing a value, 0 for one value per vertex */
+		int divisor = 0;
+	};
+	
+	enum Blend {
+		/* fragments replace the target */
+		REPLACE,
+		/* fragments are added to the target */
+		ADD,
+		BLEND_UNKNOWN
+	};
+
+private:
+	GLuint _program = 0;
+	GLuint _framebuffer = 0;
+	GLuint _array_buffer = 0;
+	int _viewport[4] = {0, 0, 0, 0};
+	bool _viewport_valid = false;
+	int _unit = 0;
+	GLuint _textures[MAX_UNITS] = {0};
+	GLuint _samplers[MAX_UNITS] = {0};
+	unsigned _attrib_mask = 0;
+	AttribPointer _attrib_ptrs[MAX_ATTRIBS];
+	Blend _blend = REPLACE;
+
+	State() = default;
+
+public:
+	State(const State &) = delete;
+	State &operator=(const State &) = delete;
+
+	static State &current() {
+		static thread_local State state;
+		return state;
+	}
+
+	/* forget all cached values, e.g. after foreign code touched the context */
+	void invalidate() {
+		_program = UNKNOWN;
+		_framebuffer = UNKNOWN;
+		_array_buffer = UNKNOWN;
+		_viewport_valid = false;
+		_unit = -1;
+		for(int i = 0; i < MAX_UNITS; ++i) {
+			_textures[i] = UNKNOWN;
+			_samplers[i] = UNKNOWN;
+		}
+		for(int i = 0; i < MAX_ATTRIBS; ++i) {
+			glDisableVertexAttribArray(i);
+			if(GLEW_VERSION_3_3)
+				glVertexAttribDivisor(i, 0);
+			_attrib_ptrs[i] = AttribPointer();
+		}
+		_attrib_mask = 0;
+		_blend = BLEND_UNKNOWN;
+	}
+
+	void useProgram(GLuint id) {
+		if(_program != id) {
+			glUseProgram(id);
+			_program = id;
+		}
+	}
+	void bindFramebuffer(GLuint id) {
+		if(_framebuffer != id) {
+			glBindFramebuffer(GL_FRAMEBUFFER, id);
+			_framebuffer = id;
+		}
+	}
+	void bindArrayBuffer(GLuint id) {
+		if(_array_buffer != id) {
+			glBindBuffer(GL_ARRAY_BUFFER, id);
+			_array_buffer = id;
+		}
+	}
+	void viewport(int x, int y, int w, int h) {
+		if(!_viewport_valid || _viewport[0] != x || _viewport[1] != y || _viewport[2] != w || _viewport[3] != h) {
+			glViewport(x, y, w, h);
+			_viewport[0] = x;
+			_viewport[1] = y;
+			_viewport[2] = w;
+			_viewport[3] = h;
+			_viewport_valid = true;
+		}
+	}
+
+	void activeTexture(int unit) {
+		if(_unit != unit) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+			_unit = unit;
+		}
+	}
+	void bindTexture(GLuint id) {
+		activeTexture(_unit < 0 ? 0 : _unit);
+		if(_textures[_unit] != id) {
+			glBindTexture(GL_TEXTURE_2D, id);
+			_textures[_unit] = id;
+		}
+	}
+	void bindTexture(int unit, GLuint id) {
+		if(_textures[unit] != id) {
+			activeTexture(unit);
+			glBindTexture(GL_TEXTURE_2D, id);
+			_textures[unit] = id;
+		}
+	}
+	void bindSampler(int unit, GLuint id) {
+		if(_samplers[unit] != id) {
+			glBindSampler(unit, id);
+			_samplers[unit] = id;
+		}
+	}
+
+	/* enables exactly the attribute arrays set in mask */
+	void setAttribArrays(unsigned mask) {
+		unsigned diff = _attrib_mask ^ mask;
+		for(int i = 0; diff != 0; ++i, diff >>= 1) {
+			if(diff & 1) {
+				if(mask & (1u << i))
+					glEnableVertexAttribArray(i);
+				else
+					glDisableVertexAttribArray(i);
+			}
+		}
+		_attrib_mask = mask;
+	}
+	void attribPointer(GLuint loc, GLuint buffer, int dim, GLenum type) {
+		AttribPointer &p = _attrib_ptrs[loc];
+		if(p.buffer != buffer || p.dim != dim || p.type != type) {
+			bindArrayBuffer(buffer);
+			glVertexAttribPointer(loc, dim, type, GL_FALSE, 0, NULL);
+			p.buffer = buffer;
+			p.dim = dim;
+			p.type = type;
+		}
+	}
+	/* needs GL 3.3, never called with a nonzero divisor before */
+	void attribDivisor(GLuint loc, int divisor) {
+		AttribPointer &p = _attrib_ptrs[loc];
+		if(p.divisor != divisor) {
+			glVertexAttribDivisor(loc, divisor);
+			p.divisor = divisor;
+		}
+	}
+	void blend(Blend mode) {
+		if(_blend != mode) {
+			if(mode == ADD) {
+				glEnable(GL_BLEND);
+				glBlendFunc(GL_ONE, GL_ONE);
+			} else {
+				glDisable(GL_BLEND);
+			}
+			_blend = mode;
+		}
+	}
+
+	/* objects being deleted must be forgotten, GL may reuse their names */
+	void forgetProgram(GLuint id) {
+		if(_program == id) {
+			/* a deleted program stays in use until another one is bound */
+			glUseProgram(0);
+			_program = 0;
+		}
+	}
+	void forgetFramebuffer(GLuint id) {
+		if(_framebuffer == id)
+			_framebuffer = 0;
+	}
+	void forgetBuffer(GLuint id) {
+		if(_array_buffer == id)
+			_array_buffer = 0;
+		for(int i = 0; i < MAX_ATTRIBS; ++i) {
+			if(_attrib_ptrs[i].buffer == id) {
+				/* the divisor is state of the attribute, not of the buffer */
+				int divisor = _attrib_ptrs[i].divisor;
+				_attrib_ptrs[i] = AttribPointer();
+				_attrib_ptrs[i].divisor = divisor;
+			}
+		}
+	}
+	void forgetTexture(GLuint id) {
+		for(int i = 0; i < MAX_UNITS; ++i) {
+			if(_textures[i] == id)
+				_textures[i] = 0;
+		}
+	}
+	void forgetSampler(GLuint id) {
+		for(int i = 0; i < MAX_UNITS; ++i) {
+			if(_samplers[i] == id)
+				_samplers[i] = 0;
+		}
+	}
+};
+}
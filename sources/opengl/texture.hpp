@@ -4,6 +4,8 @@
 
 #include <cstdio>
 
+#include "state.hpp"
+
 namespace gl {
 class Texture {
 public:
@@ -25,24 +27,59 @@ private:
 	int _width = 0, _height = 0;
 	Format _format = RGB;
 	Type _type = UBYTE;
+	mutable Interpolation _inp = LINEAR;
+	mutable bool _inp_valid = false;
 	
-public:
-	Texture() {
-		glGenTextures(1, &_id);
-		
+	void _take(Texture &t) {
+		_id = t._id;
+		_width = t._width;
+		_height = t._height;
+		_format = t._format;
+		_type = t._type;
+		_inp = t._inp;
+		_inp_valid = t._inp_valid;
+		t._id = 0;
+		t._width = 0;
+		t._height = 0;
+		t._inp_valid = false;
 	}
+	void _release() {
+		if(_id != 0) {
+			State::current().forgetTexture(_id);
+			glDeleteTextures(1, &_id);
+			_id = 0;
+		}
+	}
+
+public:
+	/* the GL texture is created on the first loadData */
+	Texture() = default;
 	virtual ~Texture() {
-		glDeleteTextures(1, &_id);
+		_release();
+	}
+	Texture(const Texture &) = delete;
+	Texture &operator=(const Texture &) = delete;
+	Texture(Texture &&t) {
+		_take(t);
+	}
+	Texture &operator=(Texture &&t) {
+		if(this != &t) {
+			_release();
+			_take(t);
+		}
+		return *this;
 	}
 	
 	void bind() const {
-		glBindTexture(GL_TEXTURE_2D, _id);
+		State::current().bindTexture(_id);
 	}
 	static void unbind() {
-		glBindTexture(GL_TEXTURE_2D, 0);
+		State::current().bindTexture(0);
 	}
 	
 	void loadData(const void *data, int width, int height, Format format, Type type, Interpolation inp = LINEAR) {
+		if(_id == 0)
+			glGenTextures(1, &_id);
 		bind();
 		
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -78,8 +115,20 @@ public:
 		_format = format;
 		_type = type;
 	}
+	/* replaces the contents, keeping size and format of the last loadData */
+	void updateData(const void *data) {
+		bind();
+		glTexSubImage2D(
+		  GL_TEXTURE_2D, 0, 0, 0, _width, _height,
+		  _format == RGB ? GL_RGB : GL_RGBA, _type == FLOAT ? GL_FLOAT : GL_UNSIGNED_BYTE, data
+		);
+	}
 	
 	void setInterpolation(Interpolation inp) const {
+		if(_inp_valid && _inp == inp)
+			return;
+		_inp = inp;
+		_inp_valid = true;
 		bind();
 		switch(inp) {
 		case LINEAR:
@@ -5,41 +5,86 @@
 #include <GL/glew.h>
 
 #include "type.hpp"
+#include "exception.hpp"
+#include "state.hpp"
 
 namespace gl {
 class VertexBuffer {
 public:
 private:
-	GLuint _id;
-	long _size;
-	Type _type;
-public:
-	VertexBuffer() {
-		glGenBuffers(1, &_id);
+	GLuint _id = 0;
+	long _size = 0;
+	Type _type = FLOAT;
+	int _divisor = 0;
+	
+	void _release() {
+		if(_id != 0) {
+			State::current().forgetBuffer(_id);
+			glDeleteBuffers(1, &_id);
+			_id = 0;
+		}
 	}
+public:
+	/* the GL buffer is created on the first loadData */
+	VertexBuffer() = default;
 	~VertexBuffer() {
-		glDeleteBuffers(1, &_id);
+		_release();
+	}
+	VertexBuffer(const VertexBuffer &) = delete;
+	VertexBuffer &operator=(const VertexBuffer &) = delete;
+	VertexBuffer(VertexBuffer &&b) : _id(b._id), _size(b._size), _type(b._type), _divisor(b._divisor) {
+		b._id = 0;
+		b._size = 0;
+	}
+	VertexBuffer &operator=(VertexBuffer &&b) {
+		if(this != &b) {
+			_release();
+			_id = b._id;
+			_size = b._size;
+			_type = b._type;
+			_divisor = b._divisor;
+			b._id = 0;
+			b._size = 0;
+		}
+		return *this;
 	}
 	
 	void bind() {
-		glBindBuffer(GL_ARRAY_BUFFER, _id);
+		State::current().bindArrayBuffer(_id);
 	}
 	static void unbind() {
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		State::current().bindArrayBuffer(0);
 	}
 	
+	/* usage is GL_STREAM_DRAW for data replaced about every draw */
 	template <typename T>
-	void loadData(T *data, long size) {
+	void loadData(T *data, long size, GLenum usage = GL_STATIC_DRAW) {
+		if(_id == 0)
+			glGenBuffers(1, &_id);
 		bind();
 		_size = size;
 		_type = get_type<T>::value;
-		glBufferData(GL_ARRAY_BUFFER, size*sizeof(T), data, GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, size*sizeof(T), data, usage);
 		unbind();
 	}
 	
+	/* values of an attribute from this buffer advance once per divisor
+	 * instances instead of once per vertex, 0 makes it per vertex again */
+	void setDivisor(int divisor) {
+		if(divisor != 0 && !GLEW_VERSION_3_3)
+			throw Exception("No instancing support : GLEW_VERSION_3_3 == 0");
+		_divisor = divisor;
+	}
+	int divisor() const {
+		return _divisor;
+	}
+	
 	void draw() {
 		glDrawArrays(GL_TRIANGLES, 0, _size);
 	}
+	void drawInstanced(long vertices, long instances) {
+		glDrawArraysInstanced(GL_TRIANGLES, 0, vertices, instances);
+	}
 	
 	GLuint id() const {
 		return _id;
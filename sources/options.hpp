@@ -0,0 +1,325 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <string>
+
+#include "solver.hpp"
+#include "field2d.hpp"
+
+/* Command line settings of a run. */
+struct Options {
+	enum Tune {
+		/* settings as given */
+		TUNE_OFF,
+		/* benchmark only if the host is not in the cache yet */
+		TUNE_AUTO,
+		/* benchmark and update the cache */
+		TUNE_FORCE
+	};
+	
+	Solver::Backend backend = Solver::GL;
+	/* backend given on the command line, tuning keeps it */
+	bool backend_set = false;
+	/* device index counted over all OpenCL platforms */
+	int cl_device = 0;
+	/* temperature step between neighbouring cells above which AMR blocks are refined */
+	float amr_tol = 0.02f;
+	int amr_every = 16;
+	/* field file of the ooc backend, an unlinked temporary one if empty */
+	std::string ooc_file;
+	/* steps per pass over the file and MiB of bands in memory */
+	int ooc_fuse = 8;
+	int ooc_memory = 256;
+	/* time slices of the parareal backend, 0 for one per hardware thread */
+	int parareal_slices = 0;
+	/* fine steps per coarse step and cells per coarse cell along each side */
+	int parareal_coarse = 32;
+	int parareal_grid = 1;
+	/* largest change of a slice start at which iterations stop */
+	float parareal_tol = 1e-5f;
+	Solver::Integrator integrator = Solver::EULER;
+	/* time advanced by a single step, 0 means the integrator default */
+	double dt = 0.0;
+	/* steps per displayed frame, 0 means the integrator default */
+	int steps = 0;
+	/* cells along each side of the grid */
+	int size = 256;
+	std::string out_file = "out.txt";
+	int out_factor = 4;
+	Solver::Reduction out_mode = Solver::POINT;
+	/* field history, not recorded if empty */
+	std::string record_file;
+	int record_every = 0x80;
+	float record_error = 1e-4f;
+	int record_key = 16;
+	int record_threads = 2;
+	int record_queue = 8;
+	/* simulation health, JSON lines and Prometheus text file */
+	std::string metrics_file, metrics_prom;
+	int metrics_every = 0x400;
+	/* shared-memory ring of snapshots, not published if empty */
+	std::string shm_name;
+	int shm_every = 0x80;
+	int shm_slots = 4;
+	/* temperature over time at the points of probes_file, not sampled if empty */
+	std::string probes_file;
+	std::string probe_out = "probes.csv";
+	int probe_every = 1;
+	long metrics_rotate = 16 << 20;
+	/* backend and steps per frame picked by benchmark, cached per host */
+	Tune tune = TUNE_OFF;
+	std::string tune_cache;
+	/* backing of large host fields */
+	Field2D::Pages pages = Field2D::THP;
+	/* GPU time of each pass of the gl backend, printed now and then */
+	bool pass_timing = false;
+	
+	static void usage(const char *name) {
+		fprintf(stderr,
+		  "Usage: %s [options]\n"
+		  "  --backend <engine>       engine the solver runs on: gl, opencl, amr, hybrid, ooc\n"
+		  "                           or parareal (gl)\n"
+		  "  --cl-device <n>          OpenCL device, counted over all platforms (0)\n"
+		  "  --amr-tol <t>            refine AMR blocks above this temperature step (0.02)\n"
+		  "  --amr-every <n>          steps between AMR refinement passes (16)\n"
+		  "  --ooc-file <file>        field file of the ooc backend (a temporary one)\n"
+		  "  --ooc-fuse <n>           ooc steps fused into a pass over the file (8)\n"
+		  "  --ooc-memory <MiB>       ooc band memory (256)\n"
+		  "  --parareal-slices <n>    time slices of the steps of a frame run at once (threads)\n"
+		  "  --parareal-coarse <n>    fine steps spanned by a coarse step (32)\n"
+		  "  --parareal-grid <n>      cells per coarse cell along each side (1)\n"
+		  "  --parareal-tol <e>       change of the slice starts at which iterations stop (1e-5)\n"
+		  "  --integrator euler|rkl2  time integration scheme (euler)\n"
+		  "  --dt <time>              time advanced per step (euler: 0.1, rkl2: 12.8)\n"
+		  "  --steps <n>              steps per frame (euler: 128, rkl2: 1)\n"
+		  "  --size <n>               grid cells along each side (256)\n"
+		  "  --out <file>             field written at exit (out.txt)\n"
+		  "  --out-factor <n>         output downsampling factor (4)\n"
+		  "  --out-mode <mode>        point|box|min|max reduction of output blocks (point)\n"
+		  "  --record <file>          record compressed field history\n"
+		  "  --record-every <n>       steps between recorded frames (128)\n"
+		  "  --record-error <e>       max absolute error of recorded values (1e-4)\n"
+		  "  --record-key <n>         frames between key frames (16)\n"
+		  "  --record-threads <n>     compression threads (2)\n"
+		  "  --record-queue <n>       frames waiting before the solver blocks (8)\n"
+		  "  --metrics <file>         append step rate, heat and min/max as JSON lines\n"
+		  "  --metrics-prom <file>    keep the same metrics in a Prometheus text file\n"
+		  "  --metrics-every <n>      steps between metrics samples (1024)\n"
+		  "  --metrics-rotate <size>  bytes, K, M or G suffix, at which the JSON lines file is rotated (16M)\n"
+		  "  --shm <name>             publish snapshots in the shared-memory ring /dev/shm/<name>\n"
+		  "  --shm-every <n>          steps between published snapshots (128)\n"
+		  "  --shm-slots <n>          frames the ring holds, at least 2 (4)\n"
+		  "  --probes <file>          sample the temperature at the \"x y\" points of file, 0 to 1\n"
+		  "  --probe-out <file>       CSV of the probe samples (probes.csv)\n"
+		  "  --probe-every <n>        steps between probe samples (1)\n"
+		  "  --tune off|auto|force    pick backend, unless given, and steps per frame by benchmark (off)\n"
+		  "  --tune-cache <file>      tuning results (~/.cache/therm/tune.txt)\n"
+		  "  --pages small|thp|huge   page size of large host fields, huge needs reserved pages (thp)\n"
+		  "  --pass-timing on|off     print GPU time per pass of the gl backend (off)\n"
+		  "Environment:\n"
+		  "  THERM_SHADER_DIR         load shaders from this directory instead of the built-in ones\n",
+		  name
+		);
+	}
+	
+	/* a byte count with an optional K, M or G suffix for powers of 1024 */
+	static long parseBytes(const std::string &val) {
+		char *end = nullptr;
+		long n = strtol(val.c_str(), &end, 10);
+		switch(*end) {
+		case 'K':
+		case 'k':
+			return n << 10;
+		case 'M':
+		case 'm':
+			return n << 20;
+		case 'G':
+		case 'g':
+			return n << 30;
+		default:
+			return n;
+		}
+	}
+	
+	static Options parse(int argc, char *argv[]) {
+		Options opts;
+		for(int i = 1; i < argc; ++i) {
+			std::string arg(argv[i]);
+			if(arg == "--help" || arg == "-h") {
+				usage(argv[0]);
+				exit(0);
+			}
+			if(i + 1 >= argc) {
+				fprintf(stderr, "Unknown option or missing value '%s'\n", argv[i]);
+				usage(argv[0]);
+				exit(1);
+			}
+			std::string val(argv[++i]);
+			if(arg == "--backend") {
+				opts.backend_set = true;
+				if(val == "gl") {
+					opts.backend = Solver::GL;
+				} else if(val == "opencl") {
+					opts.backend = Solver::OPENCL;
+				} else if(val == "amr") {
+					opts.backend = Solver::AMR;
+				} else if(val == "hybrid") {
+					opts.backend = Solver::HYBRID;
+				} else if(val == "ooc") {
+					opts.backend = Solver::OOC;
+				} else if(val == "parareal") {
+					opts.backend = Solver::PARAREAL;
+				} else {
+					fprintf(stderr, "Unknown backend '%s'\n", val.c_str());
+					exit(1);
+				}
+			} else if(arg == "--cl-device") {
+				opts.cl_device = atoi(val.c_str());
+			} else if(arg == "--amr-tol") {
+				opts.amr_tol = atof(val.c_str());
+			} else if(arg == "--amr-every") {
+				opts.amr_every = atoi(val.c_str());
+			} else if(arg == "--ooc-file") {
+				opts.ooc_file = val;
+			} else if(arg == "--ooc-fuse") {
+				opts.ooc_fuse = atoi(val.c_str());
+			} else if(arg == "--ooc-memory") {
+				opts.ooc_memory = atoi(val.c_str());
+			} else if(arg == "--parareal-slices") {
+				opts.parareal_slices = atoi(val.c_str());
+			} else if(arg == "--parareal-coarse") {
+				opts.parareal_coarse = atoi(val.c_str());
+			} else if(arg == "--parareal-grid") {
+				opts.parareal_grid = atoi(val.c_str());
+			} else if(arg == "--parareal-tol") {
+				opts.parareal_tol = atof(val.c_str());
+			} else if(arg == "--integrator") {
+				if(val == "euler") {
+					opts.integrator = Solver::EULER;
+				} else if(val == "rkl2") {
+					opts.integrator = Solver::RKL2;
+				} else {
+					fprintf(stderr, "Unknown integrator '%s'\n", val.c_str());
+					exit(1);
+				}
+			} else if(arg == "--dt") {
+				opts.dt = atof(val.c_str());
+			} else if(arg == "--steps") {
+				opts.steps = atoi(val.c_str());
+			} else if(arg == "--size") {
+				opts.size = atoi(val.c_str());
+			} else if(arg == "--out") {
+				opts.out_file = val;
+			} else if(arg == "--out-factor") {
+				opts.out_factor = atoi(val.c_str());
+			} else if(arg == "--out-mode") {
+				if(val == "point") {
+					opts.out_mode = Solver::POINT;
+				} else if(val == "box") {
+					opts.out_mode = Solver::BOX;
+				} else if(val == "min") {
+					opts.out_mode = Solver::MIN;
+				} else if(val == "max") {
+					opts.out_mode = Solver::MAX;
+				} else {
+					fprintf(stderr, "Unknown output mode '%s'\n", val.c_str());
+					exit(1);
+				}
+			} else if(arg == "--record") {
+				opts.record_file = val;
+			} else if(arg == "--record-every") {
+				opts.record_every = atoi(val.c_str());
+			} else if(arg == "--record-error") {
+				opts.record_error = atof(val.c_str());
+			} else if(arg == "--record-key") {
+				opts.record_key = atoi(val.c_str());
+			} else if(arg == "--record-threads") {
+				opts.record_threads = atoi(val.c_str());
+			} else if(arg == "--record-queue") {
+				opts.record_queue = atoi(val.c_str());
+			} else if(arg == "--metrics") {
+				opts.metrics_file = val;
+			} else if(arg == "--metrics-prom") {
+				opts.metrics_prom = val;
+			} else if(arg == "--metrics-every") {
+				opts.metrics_every = atoi(val.c_str());
+			} else if(arg == "--metrics-rotate") {
+				opts.metrics_rotate = parseBytes(val);
+			} else if(arg == "--shm") {
+				opts.shm_name = val;
+			} else if(arg == "--shm-every") {
+				opts.shm_every = atoi(val.c_str());
+			} else if(arg == "--shm-slots") {
+				opts.shm_slots = atoi(val.c_str());
+			} else if(arg == "--probes") {
+				opts.probes_file = val;
+			} else if(arg == "--probe-out") {
+				opts.probe_out = val;
+			} else if(arg == "--probe-every") {
+				opts.probe_every = atoi(val.c_str());
+			} else if(arg == "--tune") {
+				if(val == "off") {
+					opts.tune = TUNE_OFF;
+				} else if(val == "auto") {
+					opts.tune = TUNE_AUTO;
+				} else if(val == "force") {
+					opts.tune = TUNE_FORCE;
+				} else {
+					fprintf(stderr, "Unknown tuning mode '%s'\n", val.c_str());
+					exit(1);
+				}
+			} else if(arg == "--tune-cache") {
+				opts.tune_cache = val;
+			} else if(arg == "--pages") {
+				if(val == "small") {
+					opts.pages = Field2D::SMALL;
+				} else if(val == "thp") {
+					opts.pages = Field2D::THP;
+				} else if(val == "huge") {
+					opts.pages = Field2D::HUGETLB;
+				} else {
+					fprintf(stderr, "Unknown page size '%s'\n", val.c_str());
+					exit(1);
+				}
+			} else if(arg == "--pass-timing") {
+				if(val == "on") {
+					opts.pass_timing = true;
+				} else if(val == "off") {
+					opts.pass_timing = false;
+				} else {
+					fprintf(stderr, "Unknown pass timing '%s'\n", val.c_str());
+					exit(1);
+				}
+			} else {
+				fprintf(stderr, "Unknown option '%s'\n", arg.c_str());
+				usage(argv[0]);
+				exit(1);
+			}
+		}
+		
+		/* one rkl2 step covers the time of an euler frame */
+		if(opts.dt <= 0.0)
+			opts.dt = opts.integrator == Solver::RKL2 ? 12.8 : 0.1;
+		if(opts.steps <= 0)
+			opts.steps = opts.integrator == Solver::RKL2 ? 1 : 0x80;
+		if(opts.size < 2) {
+			fprintf(stderr, "Grid size must be at least 2\n");
+			exit(1);
+		}
+		if(opts.record_every <= 0)
+			opts.record_every = 1;
+		if(opts.shm_every <= 0)
+			opts.shm_every = 1;
+		if(opts.probe_every <= 0)
+			opts.probe_every = 1;
+		if(opts.metrics_every <= 0)
+			opts.metrics_every = 1;
+		if(opts.record_error <= 0.0f) {
+			fprintf(stderr, "Record error bound must be positive\n");
+			exit(1);
+		}
+		return opts;
+	}
+};
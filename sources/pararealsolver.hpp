@@ -0,0 +1,430 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include "solver.hpp"
+#include "hostview.hpp"
+#include "bands.hpp"
+
+/* Heat diffusion on the CPU, parallel in time by Parareal (Lions, Maday
+ * and Turinici, 2001). The steps of a call form a window split into time
+ * slices, one per thread. A cheap coarse propagator, RKL2 with a step
+ * spanning many fine ones on a grid coarsened by a factor, sweeps the
+ * slices in order to predict where each one starts. Then every slice is
+ * advanced at once by the fine integrator from its predicted start, and
+ * the next coarse sweep corrects each start by the difference the fine
+ * integrator made. Iterations stop when no start moves by more than the
+ * tolerance; after k of them the first k slices are exactly those of a
+ * sequential run, so the window never takes more than one iteration per
+ * slice. The sweeps are sequential in time and split the rows between
+ * the threads instead. Wall time drops when a few iterations are enough,
+ * which is the case once the start of a run has smoothed out. */
+class PararealSolver : public Solver {
+private:
+	/* seconds between reports */
+	static const int REPORT = 5;
+	/* rows each thread takes at least */
+	static const int MIN_ROWS = 16;
+	
+	/* f(band, y0, y1) over h rows split between up to threads threads */
+	static void bands(int threads, int h, const std::function<void(int, int, int)> &f) {
+		Bands::shared().run(h, MIN_ROWS, f, threads);
+	}
+	
+	/* advances a temperature field by Euler or RKL2 steps of the 5-point
+	 * operator, on a grid whose cells are factor fine cells wide */
+	struct Propagator {
+		const Field2D *cond = nullptr;
+		/* 1 over the squared cell size */
+		float scale = 1.0f;
+		double dt_euler = 0.0;
+		double step_dt = 0.0;
+		bool rkl2 = false;
+		/* threads splitting the rows of a step */
+		int threads = 1;
+		std::vector<float> stages;
+		Field2D t[4], d0, d1;
+		
+		void setup(const Field2D *k, int factor, float k_max, bool use_rkl2) {
+			cond = k;
+			scale = 1.0f/(factor*factor);
+			/* no cell conducts, any step is stable */
+			dt_euler = k_max > 0.0f ? factor*factor/(4.0*k_max) : 1e30;
+			rkl2 = use_rkl2;
+			step_dt = 0.0;
+		}
+		void setStep(double step) {
+			if(step == step_dt)
+				return;
+			step_dt = step;
+			if(rkl2)
+				stages = rkl2Stages(step_dt, std::min(dt_euler, step_dt));
+		}
+		
+		/* neighbours outside of the grid mirror the cell, no heat crosses the border */
+		void derivative(const Field2D &y, Field2D &out) const {
+			int sx = y.width(), sy = y.height();
+			out.resize(1, sx, sy);
+			bands(threads, sy, [&](int, int y0, int y1) {
+				for(int iy = y0; iy < y1; ++iy) {
+					const float *t = y.row(0, iy), *k = cond->row(0, iy);
+					const float *below = iy > 0 ? y.row(0, iy - 1) : t;
+					const float *above = iy < sy - 1 ? y.row(0, iy + 1) : t;
+					float *d = out.row(0, iy);
+					for(int ix = 0; ix < sx; ++ix) {
+						float tc = t[ix];
+						float n =
+						  below[ix] + above[ix] +
+						  (ix > 0 ? t[ix - 1] : tc) + (ix < sx - 1 ? t[ix + 1] : tc);
+						d[ix] = scale*k[ix]*(n - 4.0f*tc);
+					}
+				}
+			});
+		}
+		
+		void stepEuler() {
+			int sx = t[0].width(), sy = t[0].height();
+			float fdt = float(step_dt)*scale;
+			t[1].resize(1, sx, sy);
+			bands(threads, sy, [&](int, int y0, int y1) {
+				for(int iy = y0; iy < y1; ++iy) {
+					const float *tr = t[0].row(0, iy);
+					const float *below = iy > 0 ? t[0].row(0, iy - 1) : tr;
+					const float *above = iy < sy - 1 ? t[0].row(0, iy + 1) : tr;
+					eulerRow(tr, below, above, cond->row(0, iy), t[1].row(0, iy), sx, fdt);
+				}
+			});
+			std::swap(t[0], t[1]);
+		}
+		
+		void stepRKL2() {
+			int sx = t[0].width(), sy = t[0].height();
+			float fdt = float(step_dt);
+			derivative(t[0], d0);
+			int prev = 0, prev2 = 0, next = 1;
+			for(size_t i = 0; i < stages.size(); i += 4) {
+				const float *coef = &stages[i];
+				if(i > 0)
+					derivative(t[prev], d1);
+				const Field2D &dy = i > 0 ? d1 : d0;
+				t[next].resize(1, sx, sy);
+				bands(threads, sy, [&](int, int r0, int r1) {
+					for(int iy = r0; iy < r1; ++iy) {
+						const float *y0 = t[0].row(0, iy), *yp = t[prev].row(0, iy), *yp2 = t[prev2].row(0, iy);
+						const float *g = dy.row(0, iy), *g0 = d0.row(0, iy);
+						float *d = t[next].row(0, iy);
+						for(int ix = 0; ix < sx; ++ix) {
+							d[ix] =
+							  coef[0]*yp[ix] + coef[1]*yp2[ix] + (1.0f - coef[0] - coef[1])*y0[ix] +
+							  fdt*(coef[2]*g[ix] + coef[3]*g0[ix]);
+						}
+					}
+				});
+				prev2 = prev;
+				prev = next;
+				next = next % 3 + 1;
+			}
+			std::swap(t[0], t[prev]);
+		}
+		
+		/* n steps of step_dt in place */
+		void run(Field2D &temp, int n) {
+			std::swap(t[0], temp);
+			for(int i = 0; i < n; ++i) {
+				if(rkl2)
+					stepRKL2();
+				else
+					stepEuler();
+			}
+			std::swap(t[0], temp);
+		}
+	};
+	
+	int slices, coarse_steps, factor;
+	float tol;
+	
+	int sx = 0, sy = 0;
+	/* coarse grid size */
+	int cx = 0, cy = 0;
+	/* temperature and conductivity at the end of the last window */
+	Field2D state;
+	Field2D cond, coarse_cond;
+	
+	/* start of each slice, the end of the window last */
+	std::vector<Field2D> starts;
+	/* fine result of each slice from its current start */
+	std::vector<Field2D> fine;
+	/* coarse result of each slice from its current start, on the coarse grid */
+	std::vector<Field2D> coarse;
+	std::vector<Propagator> fine_prop;
+	Propagator coarse_prop;
+	/* change of a coarse result between iterations */
+	Field2D delta;
+	/* bilinear weights of the coarse cells around each fine column and row */
+	std::vector<int> col0, col1, row0, row1;
+	std::vector<float> col_w, row_w;
+	
+	long report_windows = 0, report_iterations = 0, report_slices = 0;
+	double fine_time = 0.0, coarse_time = 0.0;
+	std::chrono::steady_clock::time_point report_start;
+	
+	HostView view;
+	
+	static double seconds(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	
+	/* box average of the fine field onto the coarse grid */
+	void coarsen(const Field2D &src, Field2D &dst) const {
+		dst.resize(1, cx, cy);
+		bands(slices, cy, [&](int, int r0, int r1) {
+			for(int jy = r0; jy < r1; ++jy) {
+				int y1 = std::min((jy + 1)*factor, sy);
+				float *d = dst.row(0, jy);
+				for(int jx = 0; jx < cx; ++jx) {
+					int x1 = std::min((jx + 1)*factor, sx);
+					float sum = 0.0f;
+					for(int iy = jy*factor; iy < y1; ++iy) {
+						const float *s = src.row(0, iy);
+						for(int ix = jx*factor; ix < x1; ++ix) {
+							sum += s[ix];
+						}
+					}
+					d[jx] = sum/((y1 - jy*factor)*(x1 - jx*factor));
+				}
+			}
+		});
+	}
+	
+	static void weights(int n, int f, int cn, std::vector<int> &c0, std::vector<int> &c1, std::vector<float> &w) {
+		c0.resize(n);
+		c1.resize(n);
+		w.resize(n);
+		for(int i = 0; i < n; ++i) {
+			double c = (i + 0.5)/f - 0.5;
+			int lo = std::max(0, std::min(cn - 1, int(std::floor(c))));
+			c0[i] = lo;
+			c1[i] = std::min(lo + 1, cn - 1);
+			w[i] = float(std::max(0.0, std::min(1.0, c - lo)));
+		}
+	}
+	
+	/* out = base plus, in conducting cells, the coarse field d interpolated
+	 * to the fine grid, or just the interpolated field if replace; other
+	 * cells never change. out may be base, returns the largest difference
+	 * of out to prev if given. */
+	float combine(const Field2D &d, const Field2D &base, bool replace, Field2D &out, const Field2D *prev) const {
+		std::vector<float> change(slices, 0.0f);
+		bands(slices, sy, [&](int band, int y0, int y1) {
+			for(int iy = y0; iy < y1; ++iy) {
+				const float *d0 = d.row(0, row0[iy]), *d1 = d.row(0, row1[iy]);
+				const float *b = base.row(0, iy), *k = cond.row(0, iy);
+				const float *p = prev != nullptr ? prev->row(0, iy) : nullptr;
+				float wy = row_w[iy];
+				float *r = out.row(0, iy);
+				for(int ix = 0; ix < sx; ++ix) {
+					float v = b[ix];
+					if(k[ix] > 0.0f) {
+						int x0 = col0[ix], x1 = col1[ix];
+						float wx = col_w[ix];
+						float c =
+						  (1.0f - wy)*((1.0f - wx)*d0[x0] + wx*d0[x1]) +
+						  wy*((1.0f - wx)*d1[x0] + wx*d1[x1]);
+						v = replace ? c : v + c;
+					}
+					if(p != nullptr)
+						change[band] = std::max(change[band], std::fabs(v - p[ix]));
+					r[ix] = v;
+				}
+			}
+		});
+		return *std::max_element(change.begin(), change.end());
+	}
+	
+	/* coarse steps of about coarse_steps fine ones over n fine steps */
+	void coarseSlice(const Field2D &start, int n, Field2D &out) {
+		int m = std::max(1, (n + coarse_steps/2)/coarse_steps);
+		coarsen(start, out);
+		coarse_prop.setStep(n*dt/m);
+		coarse_prop.run(out, m);
+	}
+	void fineSlice(int j, int n) {
+		fine[j] = starts[j];
+		fine_prop[j].run(fine[j], n);
+	}
+	
+	/* n steps in count slices */
+	void window(int n, int count) {
+		std::vector<int> len(count);
+		for(int j = 0; j < count; ++j) {
+			len[j] = int(long(n)*(j + 1)/count - long(n)*j/count);
+		}
+		starts.resize(count + 1);
+		fine.resize(count);
+		coarse.resize(count);
+		for(Field2D &f : starts) {
+			f.resize(1, sx, sy);
+		}
+		memcpy(starts[0].plane(0), state.plane(TEMP), sizeof(float)*state.stride()*sy);
+		
+		/* the prediction is the coarse sweep alone */
+		auto t0 = std::chrono::steady_clock::now();
+		for(int j = 0; j < count; ++j) {
+			coarseSlice(starts[j], len[j], coarse[j]);
+			combine(coarse[j], starts[j], true, starts[j + 1], nullptr);
+		}
+		coarse_time += seconds(t0);
+		
+		/* slices before first are exact */
+		int first = 0;
+		while(first < count) {
+			t0 = std::chrono::steady_clock::now();
+			Bands::shared().run(count - first, 1, [&](int, int j0, int j1) {
+				for(int j = first + j0; j < first + j1; ++j) {
+					fineSlice(j, len[j]);
+				}
+			});
+			fine_time += seconds(t0);
+			report_slices += count - first;
+			report_iterations += 1;
+			
+			/* the start of the first slice did not move, so its end is the fine one */
+			t0 = std::chrono::steady_clock::now();
+			std::swap(starts[first + 1], fine[first]);
+			float change = 0.0f;
+			for(int iy = 0; iy < sy; ++iy) {
+				const float *a = starts[first + 1].row(0, iy), *b = fine[first].row(0, iy);
+				for(int ix = 0; ix < sx; ++ix) {
+					change = std::max(change, std::fabs(a[ix] - b[ix]));
+				}
+			}
+			/* starts[j + 1] = fine + new coarse - old coarse */
+			for(int j = first + 1; j < count; ++j) {
+				coarseSlice(starts[j], len[j], delta);
+				std::swap(delta, coarse[j]);
+				for(int iy = 0; iy < cy; ++iy) {
+					const float *g = coarse[j].row(0, iy);
+					float *d = delta.row(0, iy);
+					for(int ix = 0; ix < cx; ++ix) {
+						d[ix] = g[ix] - d[ix];
+					}
+				}
+				change = std::max(change, combine(delta, fine[j], false, fine[j], &starts[j + 1]));
+				std::swap(fine[j], starts[j + 1]);
+			}
+			coarse_time += seconds(t0);
+			first += 1;
+			if(change <= tol)
+				break;
+		}
+		memcpy(state.plane(TEMP), starts[count].plane(0), sizeof(float)*state.stride()*sy);
+		report_windows += 1;
+	}
+	
+	void report() {
+		double elapsed = seconds(report_start);
+		if(elapsed < REPORT || report_windows == 0)
+			return;
+		fprintf(stderr,
+		  "Parareal: %.2f iterations per window, %.1f slices advanced per iteration, %.0f%% of the time in coarse sweeps\n",
+		  double(report_iterations)/report_windows, double(report_slices)/report_iterations,
+		  100.0*coarse_time/std::max(fine_time + coarse_time, 1e-9)
+		);
+		report_windows = 0;
+		report_iterations = 0;
+		report_slices = 0;
+		fine_time = 0.0;
+		coarse_time = 0.0;
+		report_start = std::chrono::steady_clock::now();
+	}
+
+protected:
+	void load(const Field2D &s) override {
+		sx = s.width();
+		sy = s.height();
+		state = s;
+		cond.resize(1, sx, sy);
+		memcpy(cond.plane(0), state.plane(COND), sizeof(float)*state.stride()*sy);
+		
+		cx = (sx + factor - 1)/factor;
+		cy = (sy + factor - 1)/factor;
+		coarsen(cond, coarse_cond);
+		weights(sx, factor, cx, col0, col1, col_w);
+		weights(sy, factor, cy, row0, row1, row_w);
+		
+		float k_max = 0.0f, coarse_k_max = 0.0f;
+		for(int iy = 0; iy < sy; ++iy) {
+			const float *k = cond.row(0, iy);
+			k_max = std::max(k_max, *std::max_element(k, k + sx));
+		}
+		for(int iy = 0; iy < cy; ++iy) {
+			const float *k = coarse_cond.row(0, iy);
+			coarse_k_max = std::max(coarse_k_max, *std::max_element(k, k + cx));
+		}
+		fine_prop.resize(slices);
+		for(Propagator &p : fine_prop) {
+			p.setup(&cond, 1, k_max, integrator == RKL2);
+			/* the stages setupIntegrator derived for dt */
+			p.step_dt = dt;
+			p.stages = stages;
+		}
+		coarse_prop.setup(&coarse_cond, factor, coarse_k_max, true);
+		/* the coarse sweep runs alone, so its steps take all threads */
+		coarse_prop.threads = slices;
+	}
+
+public:
+	/* slice_count slices at most, 0 for one per hardware thread; a coarse step
+	 * spans coarse_ratio fine steps on a grid coarse_factor times coarser */
+	PararealSolver(Integrator integ, double step_dt, int slice_count, int coarse_ratio, int coarse_factor, float tolerance)
+	  : Solver(integ, step_dt), slices(slice_count > 0 ? slice_count : Field2D::bands()),
+	  coarse_steps(std::max(1, coarse_ratio)), factor(std::max(1, coarse_factor)), tol(tolerance)
+	{
+		report_start = std::chrono::steady_clock::now();
+	}
+	
+	const char *name() const override {
+		return "parareal";
+	}
+	int width() const override {
+		return sx;
+	}
+	int height() const override {
+		return sy;
+	}
+	
+	/* windows too short for two slices of a coarse step each are split by rows instead */
+	void step(int n) override {
+		int count = std::min(slices, n/coarse_steps);
+		if(count < 2) {
+			Field2D temp(1, sx, sy);
+			memcpy(temp.plane(0), state.plane(TEMP), sizeof(float)*state.stride()*sy);
+			fine_prop[0].threads = slices;
+			fine_prop[0].run(temp, n);
+			fine_prop[0].threads = 1;
+			memcpy(state.plane(TEMP), temp.plane(0), sizeof(float)*state.stride()*sy);
+			return;
+		}
+		window(n, count);
+		report();
+	}
+	
+	void readState(Field2D &s) override {
+		s = state;
+	}
+	void readField(Field2D &data) override {
+		data.resize(1, sx, sy);
+		memcpy(data.plane(0), state.plane(TEMP), sizeof(float)*state.stride()*sy);
+	}
+	
+	void copy(gl::FrameBuffer *dst) override {
+		view.draw(state, dst);
+	}
+};
@@ -0,0 +1,370 @@
+#pragma once
+
+#include <cstdio>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+#include <GL/glew.h>
+
+#include "opengl/program.hpp"
+#include "opengl/framebuffer.hpp"
+#include "opengl/sampler.hpp"
+#include "opengl/pool.hpp"
+
+/* Full screen passes declared by the resources they read and write,
+ * compiled once into a plan of framebuffer slots. Each resource has a
+ * single writer per run. The state resource carries over between runs:
+ * reading it gives the state at the start of the run and writing it
+ * gives the state of the next one, so ping-pong targets need no
+ * bookkeeping by the caller. Transient resources share slots as soon as
+ * nothing reads them any more, and attached framebuffers are read or
+ * written in place. */
+class PassGraph {
+public:
+	struct Pass {
+		std::string name;
+		gl::Program *program;
+		/* sampler uniforms and the resources bound to them */
+		std::vector<std::pair<std::string, std::string>> inputs;
+		std::string output;
+		/* sets the uniforms of the pass other than its inputs, may be empty */
+		std::function<void(gl::Program *)> setup;
+		
+		Pass(
+		  const std::string &n, gl::Program *prog,
+		  const std::vector<std::pair<std::string, std::string>> &in, const std::string &out,
+		  const std::function<void(gl::Program *)> &s = nullptr
+		) : name(n), program(prog), inputs(in), output(out), setup(s) {}
+	};
+
+private:
+	/* runs between timed ones */
+	static const int TIME_EVERY = 64;
+	/* timed runs averaged in a report */
+	static const int REPORT_EVERY = 16;
+	
+	/* slots are indices into slots, attached framebuffers are -1 - index */
+	struct Step {
+		size_t pass;
+		std::vector<int> inputs;
+		int output;
+	};
+	struct Timing {
+		std::vector<GLuint> queries;
+	};
+	
+	std::string state_name;
+	gl::FrameBufferPool *pool;
+	const gl::Sampler *sampler;
+	
+	std::vector<Pass> passes;
+	std::vector<std::string> attached_names;
+	std::vector<gl::FrameBuffer *> attached;
+	
+	bool compiled = false;
+	std::vector<Step> plan;
+	int slot_count = 1;
+	/* slot the new state is written into, 0 if no pass writes it */
+	int result = 0;
+	/* slots[0] holds the state, a deque so that it never moves */
+	std::deque<gl::FrameBuffer> slots;
+	
+	bool timing = false;
+	long runs = 0;
+	std::deque<Timing> pending;
+	std::vector<GLuint> free_queries;
+	/* nanoseconds per pass summed over the timed runs */
+	std::vector<double> time_sum;
+	int timed = 0;
+	
+	int find(const std::string &name) const {
+		for(size_t i = 0; i < attached_names.size(); ++i) {
+			if(attached_names[i] == name)
+				return -1 - int(i);
+		}
+		return 0;
+	}
+	
+	gl::FrameBuffer *target(int ref) {
+		return ref < 0 ? attached[-1 - ref] : &slots[ref];
+	}
+	
+	/* orders the passes after the writers of their inputs and assigns slots */
+	void compile() {
+		std::map<std::string, size_t> writer;
+		for(size_t i = 0; i < passes.size(); ++i) {
+			const std::string &out = passes[i].output;
+			if(writer.count(out) != 0)
+				throw std::runtime_error("PassGraph: '" + out + "' is written by '" + passes[writer[out]].name + "' and '" + passes[i].name + "'");
+			writer[out] = i;
+		}
+		
+		/* declaration order among the passes that are ready */
+		std::vector<size_t> order;
+		std::vector<bool> done(passes.size(), false);
+		std::map<std::string, bool> ready;
+		while(order.size() < passes.size()) {
+			bool progress = false;
+			for(size_t i = 0; i < passes.size(); ++i) {
+				if(done[i])
+					continue;
+				bool can = true;
+				for(const auto &in : passes[i].inputs) {
+					const std::string &r = in.second;
+					if(r != state_name && find(r) == 0 && !ready[r]) {
+						if(writer.count(r) == 0)
+							throw std::runtime_error("PassGraph: nothing writes '" + r + "' read by '" + passes[i].name + "'");
+						can = false;
+					}
+				}
+				if(can) {
+					order.push_back(i);
+					done[i] = true;
+					ready[passes[i].output] = true;
+					progress = true;
+				}
+			}
+			if(!progress)
+				throw std::runtime_error("PassGraph: passes depend on each other in a cycle");
+		}
+		
+		std::map<std::string, size_t> last_use;
+		for(size_t k = 0; k < order.size(); ++k) {
+			for(const auto &in : passes[order[k]].inputs) {
+				last_use[in.second] = k;
+			}
+		}
+		
+		plan.clear();
+		slot_count = 1;
+		result = 0;
+		std::vector<int> free_slots;
+		std::map<std::string, int> slot_of;
+		slot_of[state_name] = 0;
+		for(size_t k = 0; k < order.size(); ++k) {
+			const Pass &p = passes[order[k]];
+			Step step;
+			step.pass = order[k];
+			for(const auto &in : p.inputs) {
+				int a = find(in.second);
+				step.inputs.push_back(a < 0 ? a : slot_of[in.second]);
+			}
+			step.output = find(p.output);
+			if(step.output == 0) {
+				if(free_slots.empty()) {
+					step.output = slot_count++;
+				} else {
+					step.output = free_slots.back();
+					free_slots.pop_back();
+				}
+				if(p.output == state_name)
+					result = step.output;
+				else
+					slot_of[p.output] = step.output;
+			}
+			plan.push_back(step);
+			
+			/* the old state stays in slot 0 until the end of the run */
+			for(const auto &in : p.inputs) {
+				const std::string &r = in.second;
+				if(r != state_name && find(r) == 0 && last_use[r] == k && slot_of.count(r) != 0) {
+					free_slots.push_back(slot_of[r]);
+					slot_of.erase(r);
+				}
+			}
+			/* written but never read */
+			if(p.output != state_name && slot_of.count(p.output) != 0 && last_use.count(p.output) == 0) {
+				free_slots.push_back(slot_of[p.output]);
+				slot_of.erase(p.output);
+			}
+		}
+		compiled = true;
+		allocate();
+	}
+	
+	/* targets of the size of the state for every slot of the plan */
+	void allocate() {
+		if(slots.empty())
+			slots.resize(1);
+		int w = slots[0].width(), h = slots[0].height();
+		if(w == 0 || h == 0)
+			return;
+		for(size_t i = 1; i < slots.size(); ++i) {
+			if(int(i) >= slot_count || slots[i].width() != w || slots[i].height() != h)
+				pool->release(std::move(slots[i]));
+		}
+		slots.resize(std::max(size_t(slot_count), size_t(1)));
+		for(size_t i = 1; i < slots.size(); ++i) {
+			if(slots[i].id() == 0)
+				slots[i] = pool->acquire(w, h);
+		}
+	}
+	
+	GLuint query() {
+		GLuint q;
+		if(free_queries.empty()) {
+			glGenQueries(1, &q);
+		} else {
+			q = free_queries.back();
+			free_queries.pop_back();
+		}
+		return q;
+	}
+	
+	/* collects timed runs whose results have arrived, never waits for them */
+	void collect() {
+		while(!pending.empty()) {
+			Timing &t = pending.front();
+			GLint available = 0;
+			glGetQueryObjectiv(t.queries.back(), GL_QUERY_RESULT_AVAILABLE, &available);
+			if(!available)
+				break;
+			std::vector<GLuint64> stamps(t.queries.size());
+			for(size_t i = 0; i < t.queries.size(); ++i) {
+				glGetQueryObjectui64v(t.queries[i], GL_QUERY_RESULT, &stamps[i]);
+				free_queries.push_back(t.queries[i]);
+			}
+			pending.pop_front();
+			if(stamps.size() != plan.size() + 1)
+				continue;
+			time_sum.resize(plan.size(), 0.0);
+			for(size_t k = 0; k < plan.size(); ++k) {
+				time_sum[k] += double(stamps[k + 1] - stamps[k]);
+			}
+			timed += 1;
+			if(timed >= REPORT_EVERY)
+				report();
+		}
+	}
+	
+	/* average time of each pass name per run */
+	void report() {
+		std::vector<std::pair<std::string, double>> sums;
+		for(size_t k = 0; k < plan.size(); ++k) {
+			const std::string &n = passes[plan[k].pass].name;
+			auto iter = sums.begin();
+			while(iter != sums.end() && iter->first != n)
+				++iter;
+			if(iter == sums.end())
+				sums.push_back(std::make_pair(n, time_sum[k]));
+			else
+				iter->second += time_sum[k];
+		}
+		for(const auto &s : sums) {
+			fprintf(stderr, "Pass %s: %.3f ms\n", s.first.c_str(), 1e-6*s.second/timed);
+		}
+		time_sum.assign(plan.size(), 0.0);
+		timed = 0;
+	}
+	
+	void dropTimings() {
+		for(Timing &t : pending) {
+			free_queries.insert(free_queries.end(), t.queries.begin(), t.queries.end());
+		}
+		pending.clear();
+		time_sum.clear();
+		timed = 0;
+	}
+
+public:
+	/* pass targets come from the pool and are sampled through sampler */
+	PassGraph(gl::FrameBufferPool *p, const gl::Sampler *s, const std::string &state = "state")
+	  : state_name(state), pool(p), sampler(s), slots(1) {}
+	~PassGraph() {
+		dropTimings();
+		if(!free_queries.empty())
+			glDeleteQueries(free_queries.size(), free_queries.data());
+	}
+	PassGraph(const PassGraph &) = delete;
+	PassGraph &operator=(const PassGraph &) = delete;
+	
+	static bool timers() {
+		return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	}
+	
+	/* prints the GPU time of each pass now and then, if timer queries are supported */
+	void setTiming(bool on) {
+		timing = on && timers();
+	}
+	
+	void add(const Pass &pass) {
+		passes.push_back(pass);
+		compiled = false;
+		dropTimings();
+	}
+	void clear() {
+		passes.clear();
+		plan.clear();
+		compiled = false;
+		dropTimings();
+	}
+	/* framebuffer used in place of a resource, not owned */
+	void attach(const std::string &name, gl::FrameBuffer *fb) {
+		int ref = find(name);
+		if(ref < 0) {
+			attached[-1 - ref] = fb;
+			return;
+		}
+		attached_names.push_back(name);
+		attached.push_back(fb);
+		compiled = false;
+	}
+	
+	/* the same framebuffer object for the life of the graph, only its contents change */
+	gl::FrameBuffer &state() {
+		return slots[0];
+	}
+	const gl::FrameBuffer &state() const {
+		return slots[0];
+	}
+	/* replaces the state, the other targets follow its size */
+	void setState(gl::FrameBuffer &&fb) {
+		pool->release(std::move(slots[0]));
+		slots[0] = std::move(fb);
+		allocate();
+	}
+	/* state of undefined contents */
+	void resize(int w, int h) {
+		setState(pool->acquire(w, h));
+	}
+	
+	void run(int times = 1) {
+		if(!compiled)
+			compile();
+		for(int r = 0; r < times; ++r) {
+			Timing t;
+			bool timed_run = timing && runs % TIME_EVERY == 0;
+			runs += 1;
+			if(timed_run) {
+				collect();
+				t.queries.push_back(query());
+				glQueryCounter(t.queries.back(), GL_TIMESTAMP);
+			}
+			for(const Step &s : plan) {
+				const Pass &p = passes[s.pass];
+				for(size_t i = 0; i < p.inputs.size(); ++i) {
+					p.program->setUniform(p.inputs[i].first, target(s.inputs[i])->getTexture(), sampler);
+				}
+				if(p.setup)
+					p.setup(p.program);
+				target(s.output)->bind();
+				p.program->evaluate();
+				if(timed_run) {
+					t.queries.push_back(query());
+					glQueryCounter(t.queries.back(), GL_TIMESTAMP);
+				}
+			}
+			if(result != 0)
+				std::swap(slots[0], slots[result]);
+			if(timed_run)
+				pending.push_back(t);
+		}
+	}
+};
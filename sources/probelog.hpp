@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdio>
+
+#include <string>
+#include <vector>
+
+#include "solver.hpp"
+
+/* Time series of the temperature at a few probe points as CSV, a row per
+ * sample with the step followed by a column per probe. Probes are read
+ * from a text file of "x y" lines, from 0 to 1 across the grid. */
+class ProbeLog {
+private:
+	std::vector<Solver::Probe> _probes;
+	FILE *file = nullptr;
+	
+	void load(const std::string &fn) {
+		FILE *f = fopen(fn.c_str(), "r");
+		if(f == nullptr) {
+			perror("error open probes file");
+			return;
+		}
+		char line[256];
+		while(fgets(line, sizeof(line), f) != nullptr) {
+			Solver::Probe p;
+			if(line[0] == '#' || sscanf(line, "%f %f", &p.x, &p.y) != 2)
+				continue;
+			_probes.push_back(p);
+		}
+		fclose(f);
+	}
+
+public:
+	ProbeLog(const std::string &probes_fn, const std::string &out_fn) {
+		load(probes_fn);
+		if(_probes.empty()) {
+			fprintf(stderr, "No probes in '%s'\n", probes_fn.c_str());
+			return;
+		}
+		file = fopen(out_fn.c_str(), "w");
+		if(file == nullptr) {
+			perror("error open probe output file");
+			return;
+		}
+		fprintf(file, "step");
+		for(size_t i = 0; i < _probes.size(); ++i) {
+			fprintf(file, ",probe%zu", i);
+		}
+		fprintf(file, "\n");
+	}
+	~ProbeLog() {
+		if(file != nullptr)
+			fclose(file);
+	}
+	ProbeLog(const ProbeLog &) = delete;
+	ProbeLog &operator=(const ProbeLog &) = delete;
+	
+	/* empty if the probes could not be read */
+	const std::vector<Solver::Probe> &probes() const {
+		return _probes;
+	}
+	
+	void write(long step, const std::vector<float> &values) {
+		if(file == nullptr)
+			return;
+		fprintf(file, "%ld", step);
+		for(float v : values) {
+			fprintf(file, ",%.9g", v);
+		}
+		fprintf(file, "\n");
+	}
+};
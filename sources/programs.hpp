@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdlib>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "opengl/exception.hpp"
+#include "opengl/filereader.hpp"
+#include "opengl/shader.hpp"
+#include "opengl/program.hpp"
+
+#include "shadersources.hpp"
+
+class Programs {
+public:
+	struct ShaderInfo {
+		std::string name;
+		std::string path;
+		gl::Shader::Type type;
+		ShaderInfo(const std::string &n, const std::string &p, gl::Shader::Type t)
+		  : name(n), path(p), type(t) {}
+	};
+	
+	struct ProgramInfo {
+		std::string name;
+		std::string vert, frag;
+		ProgramInfo(const std::string &n, const std::string &v, const std::string &f)
+		  : name(n), vert(v), frag(f) {}
+	};
+
+private:
+	std::map<std::string, std::unique_ptr<gl::Shader>> shaders;
+	std::map<std::string, std::unique_ptr<gl::Program>> programs;
+	
+	static void loadSource(gl::Shader *shader, const std::string &path) {
+		std::string text = source(path);
+		shader->loadSource(text.c_str(), text.size());
+	}
+
+public:
+	Programs(const std::vector<ShaderInfo> &shader_info, const std::vector<ProgramInfo> &program_info) {
+		for(const ShaderInfo &info : shader_info) {
+			std::unique_ptr<gl::Shader> shader(new gl::Shader(info.type));
+			shader->setName(info.name);
+			loadSource(shader.get(), info.path);
+			shader->compile();
+			shaders[info.name] = std::move(shader);
+		}
+		
+		for(const ProgramInfo &info : program_info) {
+			std::unique_ptr<gl::Program> prog(new gl::Program());
+			prog->setName(info.name);
+			prog->attach(shaders[info.vert].get());
+			prog->attach(shaders[info.frag].get());
+			prog->link();
+			programs[info.name] = std::move(prog);
+		}
+	}
+	~Programs() {
+		/* programs detach their shaders on destruction */
+		programs.clear();
+		shaders.clear();
+	}
+	Programs(const Programs &) = delete;
+	Programs &operator=(const Programs &) = delete;
+	
+	/* shaders and kernels are built into the executable,
+	 * THERM_SHADER_DIR points to a directory to load them from instead */
+	static std::string source(const std::string &path) {
+		const char *dir = getenv("THERM_SHADER_DIR");
+		if(dir != nullptr && dir[0] != '\0') {
+			gl::FileReader fr(std::string(dir) + "/" + path);
+			return std::string(fr.getData(), fr.getSize());
+		}
+		auto iter = shaders::sources.find(path);
+		if(iter == shaders::sources.end())
+			throw gl::FileNotFoundException(path);
+		return iter->second;
+	}
+	
+	gl::Program *operator[](const std::string &name) {
+		return programs[name].get();
+	}
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "field2d.hpp"
+#include "solver.hpp"
+#include "thermring.h"
+
+/* Writes snapshots of the temperature into the shared-memory ring of
+ * thermring.h. Slots are sequence locked, so publishing never waits for
+ * readers however slow they are; a reader lapped by the ring notices and
+ * drops the frame instead. */
+class Publisher {
+private:
+	static const size_t HEADER = 4096;
+	
+	std::string name;
+	therm_ring_header *header = nullptr;
+	size_t size = 0;
+	int slots, max_width, max_height;
+	uint64_t frames = 0;
+	Field2D frame;
+	
+	therm_ring_slot *slotAt(uint64_t n) {
+		return reinterpret_cast<therm_ring_slot *>(reinterpret_cast<char *>(header) + HEADER + (n - 1) % slots*header->slot_size);
+	}
+
+public:
+	/* slots frames of up to width*height cells, named like "/therm" */
+	Publisher(const std::string &shm_name, int slot_count, int width, int height)
+	  : name(shm_name), slots(std::max(2, slot_count)), max_width(width), max_height(height)
+	{
+		static_assert(sizeof(therm_ring_slot) == THERM_RING_SLOT_HEADER, "therm_ring_slot must fill its header");
+		if(name.empty() || name[0] != '/')
+			name = "/" + name;
+		size_t slot_size = THERM_RING_SLOT_HEADER + sizeof(float)*Field2D::strideOf(max_width)*max_height;
+		slot_size = (slot_size + Field2D::ALIGN - 1)/Field2D::ALIGN*Field2D::ALIGN;
+		size = HEADER + slot_size*slots;
+		
+		int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+		if(fd < 0) {
+			perror("error open shared memory");
+			return;
+		}
+		if(ftruncate(fd, size) != 0) {
+			perror("error resize shared memory");
+			close(fd);
+			shm_unlink(name.c_str());
+			return;
+		}
+		void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if(p == MAP_FAILED) {
+			perror("error map shared memory");
+			shm_unlink(name.c_str());
+			return;
+		}
+		header = static_cast<therm_ring_header *>(p);
+		memcpy(header->magic, "THRMRING", 8);
+		header->version = THERM_RING_VERSION;
+		header->header_size = HEADER;
+		header->slot_count = slots;
+		header->slot_size = slot_size;
+		header->max_width = max_width;
+		header->max_height = max_height;
+		__atomic_store_n(&header->latest, uint64_t(0), __ATOMIC_RELEASE);
+	}
+	~Publisher() {
+		if(header == nullptr)
+			return;
+		munmap(header, size);
+		shm_unlink(name.c_str());
+	}
+	Publisher(const Publisher &) = delete;
+	Publisher &operator=(const Publisher &) = delete;
+	
+	/* reads the field of the solver into the next slot */
+	void publish(Solver &solver, long step) {
+		if(header == nullptr)
+			return;
+		int sx = solver.width(), sy = solver.height();
+		int factor = std::max((sx + max_width - 1)/max_width, (sy + max_height - 1)/max_height);
+		solver.readField(frame, factor, Solver::BOX);
+		
+		uint64_t n = ++frames;
+		therm_ring_slot *s = slotAt(n);
+		__atomic_store_n(&s->seq, 2*n - 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		s->step = step;
+		s->width = frame.width();
+		s->height = frame.height();
+		s->stride = Field2D::strideOf(max_width);
+		s->factor = factor;
+		float *d = reinterpret_cast<float *>(reinterpret_cast<char *>(s) + THERM_RING_SLOT_HEADER);
+		for(int iy = 0; iy < frame.height(); ++iy) {
+			memcpy(d + size_t(iy)*s->stride, frame.row(0, iy), sizeof(float)*frame.width());
+		}
+		__atomic_store_n(&s->seq, 2*n, __ATOMIC_RELEASE);
+		__atomic_store_n(&header->latest, n, __ATOMIC_RELEASE);
+	}
+};
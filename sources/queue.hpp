@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+
+/* Lock-free bounded queue for exactly one producer and one consumer thread.
+ * N must be a power of two, one slot is always kept empty. */
+template <typename T, unsigned N>
+class Queue {
+private:
+	static_assert((N & (N - 1)) == 0, "Queue size must be a power of two");
+	
+	T _data[N];
+	std::atomic<unsigned> _head{0}, _tail{0};
+
+public:
+	/* returns false if the queue is full */
+	bool push(const T &value) {
+		unsigned tail = _tail.load(std::memory_order_relaxed);
+		unsigned next = (tail + 1) & (N - 1);
+		if(next == _head.load(std::memory_order_acquire))
+			return false;
+		_data[tail] = value;
+		_tail.store(next, std::memory_order_release);
+		return true;
+	}
+	/* returns false if the queue is empty */
+	bool pop(T &value) {
+		unsigned head = _head.load(std::memory_order_relaxed);
+		if(head == _tail.load(std::memory_order_acquire))
+			return false;
+		value = _data[head];
+		_head.store((head + 1) & (N - 1), std::memory_order_release);
+		return true;
+	}
+};
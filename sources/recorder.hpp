@@ -0,0 +1,423 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include <sys/types.h>
+
+#ifdef THERM_ZSTD
+#include <zstd.h>
+#endif
+
+#include "field2d.hpp"
+
+/* Field history file, all integers are little-endian:
+ *
+ *   header  "THRMREC\0", u32 version, u32 width, u32 height,
+ *           f32 error bound, u32 key frame interval
+ *   frames  "FRME", u64 step, u32 flags, u32 raw size, u32 packed size, data
+ *   index   "INDX", u32 count, count * (u64 step, u64 frame offset)
+ *   footer  u64 index offset, "THRMIDX\0"
+ *
+ * A frame holds the temperature quantized to q = round(t/(2*error)).
+ * Key frames (flags bit 0) store q itself, others the difference to the
+ * previous frame, as zigzag varints. Bits 8-15 of flags name the codec
+ * applied on top of that. Reading a frame needs the nearest preceding
+ * key frame only, which the index allows to seek to. */
+namespace rec {
+enum Codec {
+	RAW = 0,
+	ZSTD = 1
+};
+static const uint32_t KEY = 1;
+static const uint32_t VERSION = 1;
+
+inline void put32(std::vector<uint8_t> &buf, uint32_t v) {
+	for(int i = 0; i < 4; ++i)
+		buf.push_back(uint8_t(v >> 8*i));
+}
+inline void put64(std::vector<uint8_t> &buf, uint64_t v) {
+	for(int i = 0; i < 8; ++i)
+		buf.push_back(uint8_t(v >> 8*i));
+}
+inline uint64_t get(const uint8_t *p, int n) {
+	uint64_t v = 0;
+	for(int i = 0; i < n; ++i)
+		v |= uint64_t(p[i]) << 8*i;
+	return v;
+}
+inline int64_t quantize(float v, float error) {
+	return llround(double(v)/(2.0*error));
+}
+}
+
+class Recorder {
+private:
+	typedef std::shared_ptr<const Field2D> Frame;
+	struct Job {
+		uint64_t seq, step;
+		/* prev is empty for key frames */
+		Frame frame, prev;
+	};
+	struct Packed {
+		uint64_t step;
+		uint32_t flags, raw_size;
+		std::vector<uint8_t> data;
+	};
+	
+	FILE *file = nullptr;
+	int width, height;
+	float error;
+	int key_interval;
+	size_t capacity;
+	
+	std::mutex mutex;
+	std::condition_variable cv_jobs, cv_done, cv_space;
+	std::deque<Job> jobs;
+	std::map<uint64_t, Packed> done;
+	/* frames submitted but not written yet */
+	size_t pending = 0;
+	uint64_t next_seq = 0, written_seq = 0;
+	bool closing = false;
+	Frame last;
+	
+	std::vector<std::thread> pool;
+	std::thread writer;
+	
+	/* a write failed, frames are dropped from then on */
+	std::atomic<bool> failed{false};
+	
+	/* touched by the writer thread only */
+	uint64_t offset = 0;
+	std::vector<std::pair<uint64_t, uint64_t>> index;
+	uint64_t bytes_raw = 0;
+	
+	void write(const std::vector<uint8_t> &buf) {
+		if(failed)
+			return;
+		if(fwrite(buf.data(), 1, buf.size(), file) != buf.size()) {
+			perror("error write record file");
+			fprintf(stderr, "Recording stopped after %d frames\n", int(index.size()));
+			failed = true;
+			return;
+		}
+		offset += buf.size();
+	}
+	
+	Packed pack(const Job &job) const {
+		Packed p;
+		p.step = job.step;
+		p.flags = job.prev ? 0 : rec::KEY;
+		const Field2D &f = *job.frame;
+		std::vector<uint8_t> buf;
+		buf.reserve(size_t(width)*height*2);
+		for(int y = 0; y < height; ++y) {
+			const float *r = f.row(0, y), *pr = job.prev ? job.prev->row(0, y) : nullptr;
+			for(int x = 0; x < width; ++x) {
+				int64_t q = rec::quantize(r[x], error);
+				if(pr != nullptr)
+					q -= rec::quantize(pr[x], error);
+				uint64_t z = (uint64_t(q) << 1) ^ uint64_t(q >> 63);
+				while(z >= 0x80) {
+					buf.push_back(uint8_t(z) | 0x80);
+					z >>= 7;
+				}
+				buf.push_back(uint8_t(z));
+			}
+		}
+		p.raw_size = buf.size();
+#ifdef THERM_ZSTD
+		std::vector<uint8_t> out(ZSTD_compressBound(buf.size()));
+		size_t size = ZSTD_compress(out.data(), out.size(), buf.data(), buf.size(), 3);
+		if(!ZSTD_isError(size) && size < buf.size()) {
+			out.resize(size);
+			p.flags |= rec::ZSTD << 8;
+			p.data.swap(out);
+			return p;
+		}
+#endif
+		p.flags |= rec::RAW << 8;
+		p.data.swap(buf);
+		return p;
+	}
+	
+	void compress() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			cv_jobs.wait(lock, [this]() { return closing || !jobs.empty(); });
+			if(jobs.empty())
+				return;
+			Job job = jobs.front();
+			jobs.pop_front();
+			lock.unlock();
+			Packed p = pack(job);
+			lock.lock();
+			done[job.seq] = std::move(p);
+			cv_done.notify_one();
+		}
+	}
+	
+	void writeFrames() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			cv_done.wait(lock, [this]() {
+				return done.count(written_seq) > 0 || (closing && pending == 0);
+			});
+			auto iter = done.find(written_seq);
+			if(iter == done.end())
+				return;
+			Packed p = std::move(iter->second);
+			done.erase(iter);
+			lock.unlock();
+			
+			if(!failed) {
+				uint64_t start = offset;
+				std::vector<uint8_t> head = {'F', 'R', 'M', 'E'};
+				rec::put64(head, p.step);
+				rec::put32(head, p.flags);
+				rec::put32(head, p.raw_size);
+				rec::put32(head, p.data.size());
+				write(head);
+				write(p.data);
+				if(!failed) {
+					index.push_back(std::make_pair(p.step, start));
+					bytes_raw += sizeof(float)*size_t(width)*height;
+				}
+			}
+			
+			lock.lock();
+			++written_seq;
+			--pending;
+			cv_space.notify_one();
+		}
+	}
+
+public:
+	/* threads compress frames concurrently, at most queue frames wait in memory */
+	Recorder(const std::string &fn, int w, int h, float err, int key, int threads, int queue)
+	  : width(w), height(h), error(err), key_interval(key > 0 ? key : 1), capacity(queue > 0 ? queue : 1)
+	{
+		file = fopen(fn.c_str(), "wb");
+		if(file == nullptr) {
+			perror("error open record file");
+			return;
+		}
+		std::vector<uint8_t> head = {'T', 'H', 'R', 'M', 'R', 'E', 'C', '\0'};
+		rec::put32(head, rec::VERSION);
+		rec::put32(head, width);
+		rec::put32(head, height);
+		uint32_t e;
+		memcpy(&e, &error, sizeof(e));
+		rec::put32(head, e);
+		rec::put32(head, key_interval);
+		write(head);
+		
+		if(threads < 1)
+			threads = 1;
+		for(int i = 0; i < threads; ++i) {
+			pool.push_back(std::thread(&Recorder::compress, this));
+		}
+		writer = std::thread(&Recorder::writeFrames, this);
+	}
+	~Recorder() {
+		if(file == nullptr)
+			return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closing = true;
+		}
+		cv_jobs.notify_all();
+		cv_done.notify_all();
+		for(std::thread &t : pool) {
+			t.join();
+		}
+		writer.join();
+		if(failed) {
+			fclose(file);
+			return;
+		}
+		
+		uint64_t index_offset = offset;
+		std::vector<uint8_t> tail = {'I', 'N', 'D', 'X'};
+		rec::put32(tail, index.size());
+		for(const auto &e : index) {
+			rec::put64(tail, e.first);
+			rec::put64(tail, e.second);
+		}
+		rec::put64(tail, index_offset);
+		const char magic[] = {'T', 'H', 'R', 'M', 'I', 'D', 'X', '\0'};
+		tail.insert(tail.end(), magic, magic + 8);
+		write(tail);
+		if(fclose(file) != 0 && !failed) {
+			perror("error write record file");
+			failed = true;
+		}
+		if(failed)
+			return;
+		
+		fprintf(stderr, "Recorded %d frames, %llu bytes of field into %llu bytes\n",
+		  int(index.size()), (unsigned long long)bytes_raw, (unsigned long long)offset);
+	}
+	Recorder(const Recorder &) = delete;
+	Recorder &operator=(const Recorder &) = delete;
+	
+	/* takes a width*height temperature frame, blocks only while the queue is full */
+	void record(uint64_t step, Field2D &&data) {
+		if(file == nullptr || failed)
+			return;
+		Frame frame = std::make_shared<const Field2D>(std::move(data));
+		std::unique_lock<std::mutex> lock(mutex);
+		cv_space.wait(lock, [this]() { return pending < capacity; });
+		Job job;
+		job.seq = next_seq;
+		job.step = step;
+		job.frame = frame;
+		if(next_seq % key_interval != 0)
+			job.prev = last;
+		last = frame;
+		++next_seq;
+		++pending;
+		jobs.push_back(job);
+		cv_jobs.notify_one();
+	}
+};
+
+/* Random access to the frames of a recorded history. */
+class RecordReader {
+private:
+	FILE *file = nullptr;
+	int _width = 0, _height = 0;
+	float _error = 0.0f;
+	int _key_interval = 1;
+	std::vector<std::pair<uint64_t, uint64_t>> _index;
+	
+	bool readAt(uint64_t pos, uint8_t *dst, size_t size) {
+		return fseeko(file, off_t(pos), SEEK_SET) == 0 && fread(dst, 1, size, file) == size;
+	}
+	
+	/* applies frame i to q */
+	bool apply(size_t i, std::vector<int64_t> &q, bool &key) {
+		uint8_t head[24];
+		if(!readAt(_index[i].second, head, sizeof(head)) || memcmp(head, "FRME", 4) != 0)
+			return false;
+		uint32_t flags = rec::get(head + 12, 4);
+		std::vector<uint8_t> data(rec::get(head + 20, 4));
+		if(fread(data.data(), 1, data.size(), file) != data.size())
+			return false;
+		switch((flags >> 8) & 0xff) {
+		case rec::RAW:
+			break;
+#ifdef THERM_ZSTD
+		case rec::ZSTD: {
+			std::vector<uint8_t> raw(rec::get(head + 16, 4));
+			size_t size = ZSTD_decompress(raw.data(), raw.size(), data.data(), data.size());
+			if(ZSTD_isError(size) || size != raw.size())
+				return false;
+			data.swap(raw);
+			break;
+		}
+#endif
+		default:
+			return false;
+		}
+		key = (flags & rec::KEY) != 0;
+		size_t pos = 0;
+		for(size_t j = 0; j < q.size(); ++j) {
+			uint64_t z = 0;
+			for(int shift = 0; ; shift += 7) {
+				if(pos >= data.size())
+					return false;
+				uint8_t b = data[pos++];
+				z |= uint64_t(b & 0x7f) << shift;
+				if(!(b & 0x80))
+					break;
+			}
+			int64_t v = int64_t(z >> 1) ^ -int64_t(z & 1);
+			q[j] = key ? v : q[j] + v;
+		}
+		return true;
+	}
+
+public:
+	RecordReader(const std::string &fn) {
+		file = fopen(fn.c_str(), "rb");
+		if(file == nullptr) {
+			perror("error open record file");
+			return;
+		}
+		uint8_t head[28], tail[16];
+		if(!readAt(0, head, sizeof(head)) || memcmp(head, "THRMREC", 8) != 0 ||
+		   fseeko(file, -16, SEEK_END) != 0 || fread(tail, 1, 16, file) != 16 ||
+		   memcmp(tail + 8, "THRMIDX", 8) != 0) {
+			fprintf(stderr, "'%s' is not a complete record file\n", fn.c_str());
+			fclose(file);
+			file = nullptr;
+			return;
+		}
+		_width = rec::get(head + 12, 4);
+		_height = rec::get(head + 16, 4);
+		uint32_t e = rec::get(head + 20, 4);
+		memcpy(&_error, &e, sizeof(e));
+		_key_interval = rec::get(head + 24, 4);
+		if(_key_interval < 1)
+			_key_interval = 1;
+		
+		uint8_t ih[8];
+		if(!readAt(rec::get(tail, 8), ih, 8) || memcmp(ih, "INDX", 4) != 0)
+			return;
+		std::vector<uint8_t> entries(16*rec::get(ih + 4, 4));
+		if(fread(entries.data(), 1, entries.size(), file) != entries.size())
+			return;
+		for(size_t i = 0; i < entries.size(); i += 16) {
+			_index.push_back(std::make_pair(rec::get(&entries[i], 8), rec::get(&entries[i + 8], 8)));
+		}
+	}
+	~RecordReader() {
+		if(file != nullptr)
+			fclose(file);
+	}
+	RecordReader(const RecordReader &) = delete;
+	RecordReader &operator=(const RecordReader &) = delete;
+	
+	size_t frames() const {
+		return _index.size();
+	}
+	uint64_t step(size_t i) const {
+		return _index[i].first;
+	}
+	int width() const {
+		return _width;
+	}
+	int height() const {
+		return _height;
+	}
+	
+	/* decodes frame i, starting from the nearest key frame before it */
+	bool read(size_t i, std::vector<float> &out) {
+		if(file == nullptr || i >= _index.size())
+			return false;
+		std::vector<int64_t> q(size_t(_width)*_height, 0);
+		for(size_t j = i - i % _key_interval; j <= i; ++j) {
+			bool key;
+			if(!apply(j, q, key))
+				return false;
+		}
+		out.resize(q.size());
+		for(size_t j = 0; j < q.size(); ++j) {
+			out[j] = float(q[j]*2.0*_error);
+		}
+		return true;
+	}
+};
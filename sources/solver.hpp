@@ -0,0 +1,396 @@
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <utility>
+
+#include "opengl/framebuffer.hpp"
+
+#include "field2d.hpp"
+
+/* Heat diffusion engine. The state of a grid is its temperature and
+ * conductivity, passed to and from the host as the two channels of a field.
+ * Backends hold the state wherever they compute on and only have to
+ * bring it to the host when asked, or render it into a framebuffer
+ * of the context they run in. */
+class Solver {
+public:
+	enum Backend {
+		/* fragment shaders of the GL context */
+		GL,
+		/* OpenCL device, available when built with THERM_OPENCL */
+		OPENCL,
+		/* adaptive quadtree of blocks on the CPU */
+		AMR,
+		/* rows split between the GPU and CPU threads */
+		HYBRID,
+		/* CPU threads streaming the field from a file, for grids larger than memory */
+		OOC,
+		/* CPU threads each taking a slice of time, corrected by a coarse propagator */
+		PARAREAL
+	};
+	
+	/* channels of a state */
+	enum Channel {
+		TEMP,
+		COND
+	};
+	
+	enum Integrator {
+		/* explicit Euler, dt must stay within the stability limit */
+		EULER,
+		/* Runge-Kutta-Legendre super-time-stepping, stage count follows from dt */
+		RKL2
+	};
+	
+	/* how a block of cells is reduced to one on downsampling */
+	enum Reduction {
+		POINT,
+		BOX,
+		MIN,
+		MAX
+	};
+	
+	struct Stats {
+		/* total heat, lowest and highest temperature */
+		float sum, min, max;
+	};
+	
+	/* heat injected into the cells within radius of a point on every step */
+	struct Source {
+		/* position from 0 to 1 across the grid */
+		float x, y;
+		/* in cells, sources below half a cell heat the single cell they are in */
+		float radius;
+		/* temperature added per unit of time */
+		float power;
+	};
+	
+	/* point whose temperature is sampled over time, from 0 to 1 across the grid */
+	struct Probe {
+		float x, y;
+	};
+
+protected:
+	static const int STATS_QUEUE = 4;
+	
+	Integrator integrator;
+	double dt;
+	/* mu, nu, mu~, gamma~ of each RKL2 stage */
+	std::vector<float> stages;
+	
+	/* RKL2 scheme by Meyer, Balsara and Aslam (2014), stable for
+	 * step_dt <= dt_euler*(s^2 + s - 2)/4 with s stages */
+	static std::vector<float> rkl2Stages(double step_dt, double dt_euler) {
+		int s = 2;
+		while(dt_euler*(s*s + s - 2)/4 < step_dt)
+			++s;
+		
+		std::vector<double> b(s + 1);
+		for(int j = 0; j <= s; ++j)
+			b[j] = j < 2 ? 1.0/3 : double(j*j + j - 2)/(2*j*(j + 1));
+		double w1 = 4.0/(s*s + s - 2);
+		
+		std::vector<float> stages;
+		float first[] = {1.0f, 0.0f, float(b[1]*w1), 0.0f};
+		stages.insert(stages.end(), first, first + 4);
+		for(int j = 2; j <= s; ++j) {
+			double mu = (2.0*j - 1)/j*b[j]/b[j - 1];
+			double nu = -(j - 1.0)/j*b[j]/b[j - 2];
+			float coef[] = {float(mu), float(nu), float(mu*w1), float(-(1.0 - b[j - 1])*mu*w1)};
+			stages.insert(stages.end(), coef, coef + 4);
+		}
+		return stages;
+	}
+	void setupStages(double dt_euler) {
+		stages = rkl2Stages(dt, dt_euler);
+	}
+	
+	/* checks dt against the stability limit of the finest cells
+	 * and derives the RKL2 stages from it */
+	void setupIntegrator(float k_max) {
+		/* the 5-point operator has eigenvalues down to -8*k_max */
+		double dt_euler = k_max > 0.0f ? 1.0/(4.0*k_max) : dt;
+		if(integrator == RKL2) {
+			setupStages(dt_euler);
+			if(!stable_checked)
+				fprintf(stderr, "RKL2: %d stages per step of dt = %g\n", int(stages.size()/4), dt);
+		} else if(dt > dt_euler && !stable_checked) {
+			fprintf(stderr, "Euler step dt = %g exceeds the stability limit %g\n", dt, dt_euler);
+		}
+		stable_checked = true;
+	}
+	
+	std::vector<Probe> probes;
+	
+	/* cell a probe lies in */
+	static void probeCell(const Probe &p, int sx, int sy, int &ix, int &iy) {
+		ix = std::max(0, std::min(sx - 1, int(p.x*sx)));
+		iy = std::max(0, std::min(sy - 1, int(p.y*sy)));
+	}
+	/* queues probe values sampled on the host or fetched from the backend for pollProbes */
+	void pushProbes(long step, std::vector<float> &&values) {
+		host_probes.push_back(std::make_pair(step, std::move(values)));
+	}
+	
+	/* queues stats computed on the host for pollStats */
+	bool pushStats(long tag, const Stats &st) {
+		if(host_stats.size() >= STATS_QUEUE)
+			return false;
+		host_stats.push_back(std::make_pair(tag, st));
+		return true;
+	}
+	
+	/* replaces the state of the backend, the grid size may change */
+	virtual void load(const Field2D &state) = 0;
+
+private:
+	bool stable_checked = false;
+	/* stats computed on the host, waiting to be polled */
+	std::deque<std::pair<long, Stats>> host_stats;
+	/* probe values by step, waiting to be polled */
+	std::deque<std::pair<long, std::vector<float>>> host_probes;
+
+public:
+	Solver(Integrator integ, double step_dt) : integrator(integ), dt(step_dt) {}
+	virtual ~Solver() = default;
+	Solver(const Solver &) = delete;
+	Solver &operator=(const Solver &) = delete;
+	
+	/* temperature and conductivity at the start, u and v run from 0 to 1 over the grid */
+	static void initialCell(double u, double v, float &t, float &k) {
+		double ir = 0.4;
+		std::function<double(double)>
+		inner = [](double a) {
+			return 0.5*(1.0 + cos(2*a));
+		},
+		outer = [](double a) {
+			return 0.5*(1.0 - sin(2*a));
+		};
+		double x = 2.1*(u - 0.5), y = 2.1*(v - 0.5);
+		double r = sqrt(x*x + y*y);
+		double a = atan2(y, x);
+		if(r > 1.0) {
+			t = outer(a);
+			k = 0.0;
+		} else if(r < ir) {
+			t = inner(a);
+			k = 0.0;
+		} else {
+			t = 0.0;
+			k = 1.0;
+		}
+	}
+	
+	/* the initial temperature and conductivity of a grid */
+	static void initialState(int sx, int sy, Field2D &state) {
+		state.resize(2, sx, sy);
+		for(int iy = 0; iy < sy; ++iy) {
+			float *t = state.row(TEMP, iy), *k = state.row(COND, iy);
+			for(int ix = 0; ix < sx; ++ix) {
+				initialCell(double(ix)/sx, double(iy)/sy, t[ix], k[ix]);
+			}
+		}
+	}
+	
+	/* nearest cell resampling of a field to another grid size */
+	static void resample(const Field2D &src, Field2D &dst, int dx, int dy) {
+		int sx = src.width(), sy = src.height();
+		dst.resize(src.channels(), dx, dy);
+		for(int c = 0; c < src.channels(); ++c) {
+			for(int iy = 0; iy < dy; ++iy) {
+				const float *s = src.row(c, int((iy + 0.5)*sy/dy));
+				float *d = dst.row(c, iy);
+				for(int ix = 0; ix < dx; ++ix) {
+					d[ix] = s[int((ix + 0.5)*sx/dx)];
+				}
+			}
+		}
+	}
+	
+	/* sets the state to start from, must be called before stepping */
+	void init(const Field2D &state) {
+		float k_max = 0.0f;
+		for(int iy = 0; iy < state.height(); ++iy) {
+			const float *k = state.row(COND, iy);
+			for(int ix = 0; ix < state.width(); ++ix) {
+				k_max = std::max(k_max, k[ix]);
+			}
+		}
+		setupIntegrator(k_max);
+		load(state);
+	}
+	/* starts from the initial state of a sx*sy grid */
+	virtual void start(int sx, int sy) {
+		Field2D state;
+		initialState(sx, sy, state);
+		init(state);
+	}
+	
+	virtual const char *name() const = 0;
+	virtual int width() const = 0;
+	virtual int height() const = 0;
+	
+	/* advances the field by n*dt */
+	virtual void step(int n) = 0;
+	
+	/* brings temperature and conductivity to the host */
+	virtual void readState(Field2D &state) = 0;
+	
+	/* renders the current field into dst, temperature and conductivity
+	 * in the first two channels */
+	virtual void copy(gl::FrameBuffer *dst) = 0;
+	
+	/* texture holding the whole state at grid size like copy renders it,
+	 * nullptr if the backend keeps none */
+	virtual const gl::Texture *getTexture() const {
+		return nullptr;
+	}
+	
+	/* resamples the field to a new grid size */
+	virtual void resize(int sx, int sy) {
+		if(sx == width() && sy == height())
+			return;
+		Field2D state, next;
+		readState(state);
+		resample(state, next, sx, sy);
+		load(next);
+	}
+	
+	/* reads the temperature channel back to the host, as a single channel field */
+	virtual void readField(Field2D &data) {
+		Field2D state;
+		readState(state);
+		data.resize(1, state.width(), state.height());
+		for(int iy = 0; iy < state.height(); ++iy) {
+			std::copy(state.row(TEMP, iy), state.row(TEMP, iy) + state.width(), data.row(0, iy));
+		}
+	}
+	
+	/* reads the temperature reduced by factor in both directions */
+	virtual void readField(Field2D &data, int factor, Reduction mode) {
+		if(factor <= 1) {
+			readField(data);
+			return;
+		}
+		Field2D field;
+		readField(field);
+		int sx = width(), sy = height();
+		int w = (sx + factor - 1)/factor;
+		int h = (sy + factor - 1)/factor;
+		data.resize(1, w, h);
+		for(int ty = 0; ty < h; ++ty) {
+			for(int tx = 0; tx < w; ++tx) {
+				int bx = tx*factor, by = ty*factor;
+				float v = field.at(0, bx, by);
+				if(mode != POINT) {
+					float sum = 0.0f, lo = v, hi = v;
+					int n = 0;
+					for(int iy = by; iy < std::min(by + factor, sy); ++iy) {
+						for(int ix = bx; ix < std::min(bx + factor, sx); ++ix) {
+							float s = field.at(0, ix, iy);
+							sum += s;
+							lo = std::min(lo, s);
+							hi = std::max(hi, s);
+							n += 1;
+						}
+					}
+					v = mode == BOX ? sum/n : mode == MIN ? lo : hi;
+				}
+				data.at(0, tx, ty) = v;
+			}
+		}
+	}
+	
+	/* replaces the heat sources applied from the next step on;
+	 * returns false if the backend does not support sources */
+	virtual bool setSources(const std::vector<Source> &sources) {
+		return sources.empty();
+	}
+	
+	/* starts computing stats of the current field, tag comes back with the result;
+	 * returns false if too many requests are in flight */
+	virtual bool requestStats(long tag) {
+		if(host_stats.size() >= STATS_QUEUE)
+			return false;
+		Field2D field;
+		readField(field);
+		Stats st = {0.0f, 1e30f, -1e30f};
+		for(int iy = 0; iy < field.height(); ++iy) {
+			const float *r = field.row(0, iy);
+			for(int ix = 0; ix < field.width(); ++ix) {
+				st.sum += r[ix];
+				st.min = std::min(st.min, r[ix]);
+				st.max = std::max(st.max, r[ix]);
+			}
+		}
+		return pushStats(tag, st);
+	}
+	/* takes the oldest stats if they have arrived, never waits for them */
+	virtual bool pollStats(long &tag, Stats &stats) {
+		if(host_stats.empty())
+			return false;
+		tag = host_stats.front().first;
+		stats = host_stats.front().second;
+		host_stats.pop_front();
+		return true;
+	}
+	
+	/* replaces the probes, samples of the old ones not polled yet are dropped */
+	virtual void setProbes(const std::vector<Probe> &list) {
+		probes = list;
+		host_probes.clear();
+	}
+	/* samples the temperature at the probes, the values come back tagged with step
+	 * from pollProbes; this fallback reads the whole field, backends keeping
+	 * their field elsewhere sample only the probe cells */
+	virtual void sampleProbes(long step) {
+		if(probes.empty())
+			return;
+		Field2D field;
+		readField(field);
+		std::vector<float> values(probes.size());
+		for(size_t i = 0; i < probes.size(); ++i) {
+			int ix, iy;
+			probeCell(probes[i], field.width(), field.height(), ix, iy);
+			values[i] = field.at(0, ix, iy);
+		}
+		pushProbes(step, std::move(values));
+	}
+	/* starts the transfer of samples the backend still collects */
+	virtual void flushProbes() {}
+	/* takes the values of the oldest sample, one per probe; without wait
+	 * only if they have arrived, with wait as soon as they are there */
+	virtual bool pollProbes(long &step, std::vector<float> &values, bool wait = false) {
+		if(host_probes.empty())
+			return false;
+		step = host_probes.front().first;
+		values.swap(host_probes.front().second);
+		host_probes.pop_front();
+		return true;
+	}
+	
+	void writeFile(const std::string &fn, int factor = 4, Reduction mode = POINT) {
+		FILE *f = fopen(fn.c_str(), "w");
+		if(f == nullptr) {
+			perror("error write file");
+			return;
+		}
+		Field2D data;
+		readField(data, factor, mode);
+		for(int iy = 0; iy < data.height(); ++iy) {
+			const float *r = data.row(0, iy);
+			for(int ix = 0; ix < data.width(); ++ix) {
+				fprintf(f, "%f ", r[ix]);
+			}
+			fprintf(f, "\n");
+		}
+		fclose(f);
+	}
+};
@@ -0,0 +1,295 @@
+#include <cstdio>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+
+#include <SDL2/SDL.h>
+#include <GL/glew.h>
+
+#include "opengl/framebuffer.hpp"
+#include "opengl/mappedbuffer.hpp"
+
+#include "field2d.hpp"
+
+#include "solver.hpp"
+#include "backends.hpp"
+#include "options.hpp"
+
+#include "therm.h"
+
+/* Hidden window and GL context shared by all simulations, there may be
+ * only one context per thread for the binding state of the wrappers. */
+class LibraryContext {
+private:
+	SDL_Window *window = nullptr;
+	SDL_GLContext context = nullptr;
+	int users = 0;
+	
+	void open() {
+		if(SDL_InitSubSystem(SDL_INIT_VIDEO) != 0)
+			throw std::runtime_error(std::string("Could not init SDL video: ") + SDL_GetError());
+		window = SDL_CreateWindow("therm", 0, 0, 1, 1, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+		if(window == nullptr) {
+			SDL_QuitSubSystem(SDL_INIT_VIDEO);
+			throw std::runtime_error("Could not create SDL_Window");
+		}
+		context = SDL_GL_CreateContext(window);
+		if(context == nullptr) {
+			close();
+			throw std::runtime_error("Could not create SDL_GL_Context");
+		}
+		GLenum status = glewInit();
+		if(status != GLEW_OK) {
+			close();
+			throw std::runtime_error("Could not init GLEW");
+		}
+		if(!GLEW_VERSION_3_0) {
+			close();
+			throw std::runtime_error("OpenGL 3.0 support not found");
+		}
+	}
+	void close() {
+		if(context != nullptr)
+			SDL_GL_DeleteContext(context);
+		if(window != nullptr)
+			SDL_DestroyWindow(window);
+		context = nullptr;
+		window = nullptr;
+		SDL_QuitSubSystem(SDL_INIT_VIDEO);
+	}
+
+public:
+	static LibraryContext &instance() {
+		static LibraryContext ctx;
+		return ctx;
+	}
+	
+	void acquire() {
+		if(users == 0)
+			open();
+		users += 1;
+	}
+	void release() {
+		users -= 1;
+		if(users == 0)
+			close();
+	}
+};
+
+struct therm_sim {
+	Options opts;
+	std::unique_ptr<Solver> solver;
+	long steps = 0;
+	
+	/* field rendered by the solver and read back into the pinned buffer */
+	gl::FrameBuffer target;
+	std::unique_ptr<gl::MappedBuffer> pinned;
+	/* state on the host where the field can not go through the GPU */
+	Field2D host;
+	
+	/* the GPU path needs a solver whose state is a texture, persistent
+	 * mapping and a field fitting into a texture; copy() of the others
+	 * draws from host memory or only a preview */
+	bool mappable() const {
+		if(solver->getTexture() == nullptr || !gl::MappedBuffer::supported())
+			return false;
+		GLint max_size = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+		return solver->width() <= max_size && solver->height() <= max_size;
+	}
+	
+	void map(therm_field *field) {
+		int w = solver->width(), h = solver->height();
+		field->width = w;
+		field->height = h;
+		if(!mappable()) {
+			solver->readState(host);
+			field->temperature = host.plane(Solver::TEMP);
+			field->conductivity = host.plane(Solver::COND);
+			field->stride_x = sizeof(float);
+			field->stride_y = sizeof(float)*host.stride();
+			return;
+		}
+		
+		if(target.width() != w || target.height() != h)
+			target.setSize(w, h);
+		solver->copy(&target);
+		long size = 4*sizeof(float)*long(w)*h;
+		if(!pinned || pinned->size() != size)
+			pinned.reset(new gl::MappedBuffer(GL_PIXEL_PACK_BUFFER, size));
+		target.bind();
+		pinned->bind();
+		glReadPixels(0, 0, w, h, GL_RGBA, GL_FLOAT, nullptr);
+		pinned->unbind();
+		gl::FrameBuffer::unbind();
+		pinned->fence();
+		pinned->wait();
+		
+		const float *data = static_cast<const float *>(pinned->data());
+		field->temperature = data;
+		field->conductivity = data + 1;
+		field->stride_x = 4*sizeof(float);
+		field->stride_y = 4*sizeof(float)*w;
+	}
+	
+	void unmap() {
+		host = Field2D();
+	}
+	
+	void setRegion(int x, int y, int w, int h, float t, float k) {
+		int sx = solver->width(), sy = solver->height();
+		int x0 = std::max(x, 0), y0 = std::max(y, 0);
+		int x1 = std::min(x + w, sx), y1 = std::min(y + h, sy);
+		if(x0 >= x1 || y0 >= y1)
+			return;
+		Field2D state;
+		solver->readState(state);
+		for(int iy = y0; iy < y1; ++iy) {
+			if(t >= 0.0f)
+				std::fill(state.row(Solver::TEMP, iy) + x0, state.row(Solver::TEMP, iy) + x1, t);
+			if(k >= 0.0f)
+				std::fill(state.row(Solver::COND, iy) + x0, state.row(Solver::COND, iy) + x1, k);
+		}
+		solver->init(state);
+	}
+	
+	void setSources(const therm_source *sources, int count) {
+		std::vector<Solver::Source> list(count);
+		for(int i = 0; i < count; ++i) {
+			list[i].x = sources[i].x;
+			list[i].y = sources[i].y;
+			list[i].radius = sources[i].radius;
+			list[i].power = sources[i].power;
+		}
+		if(!solver->setSources(list))
+			throw std::runtime_error(std::string("Backend '") + solver->name() + "' does not support heat sources");
+	}
+};
+
+static thread_local std::string last_error;
+
+/* runs f, turning exceptions into the error of the thread */
+template <typename F>
+static int guard(F f) {
+	try {
+		f();
+		return 0;
+	} catch(const std::exception &e) {
+		last_error = e.what();
+	} catch(...) {
+		last_error = "unknown error";
+	}
+	return -1;
+}
+
+extern "C" {
+
+int therm_api_version(void) {
+	return THERM_API_VERSION;
+}
+
+const char *therm_error(void) {
+	return last_error.c_str();
+}
+
+void therm_config_default(therm_config *config) {
+	Options opts;
+	config->backend = opts.backend;
+	config->integrator = opts.integrator;
+	config->dt = opts.dt;
+	config->size = opts.size;
+	config->cl_device = opts.cl_device;
+	config->amr_tol = opts.amr_tol;
+	config->amr_every = opts.amr_every;
+}
+
+therm_sim *therm_create(const therm_config *config) {
+	therm_sim *sim = nullptr;
+	bool acquired = false;
+	int status = guard([&]() {
+		if(config->size < 2)
+			throw std::runtime_error("Grid size must be at least 2");
+		if(config->backend < THERM_BACKEND_GL || config->backend > THERM_BACKEND_PARAREAL)
+			throw std::runtime_error("Unknown backend");
+		if(config->integrator != THERM_EULER && config->integrator != THERM_RKL2)
+			throw std::runtime_error("Unknown integrator");
+		LibraryContext::instance().acquire();
+		acquired = true;
+		sim = new therm_sim;
+		Options &opts = sim->opts;
+		opts.backend = Solver::Backend(config->backend);
+		opts.integrator = Solver::Integrator(config->integrator);
+		opts.dt = config->dt;
+		opts.size = config->size;
+		opts.cl_device = config->cl_device;
+		opts.amr_tol = config->amr_tol;
+		opts.amr_every = config->amr_every;
+		/* same default as on the command line */
+		if(opts.dt <= 0.0)
+			opts.dt = opts.integrator == Solver::RKL2 ? 12.8 : 0.1;
+		sim->solver = createSolver(opts);
+	});
+	if(status != 0) {
+		delete sim;
+		if(acquired)
+			LibraryContext::instance().release();
+		return nullptr;
+	}
+	return sim;
+}
+
+void therm_destroy(therm_sim *sim) {
+	if(sim == nullptr)
+		return;
+	delete sim;
+	LibraryContext::instance().release();
+}
+
+int therm_width(const therm_sim *sim) {
+	return sim->solver->width();
+}
+
+int therm_height(const therm_sim *sim) {
+	return sim->solver->height();
+}
+
+long therm_steps(const therm_sim *sim) {
+	return sim->steps;
+}
+
+int therm_step(therm_sim *sim, int n) {
+	return guard([&]() {
+		if(n <= 0)
+			return;
+		sim->solver->step(n);
+		sim->steps += n;
+	});
+}
+
+int therm_map_field(therm_sim *sim, therm_field *field) {
+	return guard([&]() {
+		sim->map(field);
+	});
+}
+
+void therm_unmap_field(therm_sim *sim) {
+	sim->unmap();
+}
+
+int therm_set_region(therm_sim *sim, int x, int y, int w, int h, float temperature, float conductivity) {
+	return guard([&]() {
+		sim->setRegion(x, y, w, h, temperature, conductivity);
+	});
+}
+
+int therm_set_sources(therm_sim *sim, const therm_source *sources, int count) {
+	return guard([&]() {
+		sim->setSources(sources, count);
+	});
+}
+
+}
@@ -0,0 +1,102 @@
+#ifndef THERM_H
+#define THERM_H
+
+/* C interface of libtherm, the simulation without the window.
+ *
+ * A simulation owns a hidden GL context, shared by all simulations of the
+ * process and created with the first one. All calls have to come from the
+ * thread that created the first simulation. Functions returning int give 0
+ * on success and -1 on failure, therm_error() then describes the failure. */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define THERM_API_VERSION 2
+
+enum therm_backend {
+	THERM_BACKEND_GL = 0,
+	THERM_BACKEND_OPENCL = 1,
+	THERM_BACKEND_AMR = 2,
+	THERM_BACKEND_HYBRID = 3,
+	THERM_BACKEND_OOC = 4,
+	THERM_BACKEND_PARAREAL = 5
+};
+
+enum therm_integrator {
+	THERM_EULER = 0,
+	THERM_RKL2 = 1
+};
+
+typedef struct therm_config {
+	int backend;
+	int integrator;
+	/* time advanced by a single step, 0 means the integrator default */
+	double dt;
+	/* cells along each side of the grid */
+	int size;
+	int cl_device;
+	float amr_tol;
+	int amr_every;
+} therm_config;
+
+/* Strided view of the current field. Strides are in bytes, like the
+ * buffer protocol of Python, the cell (x, y) is at
+ * (char *)temperature + y*stride_y + x*stride_x. */
+typedef struct therm_field {
+	const float *temperature;
+	const float *conductivity;
+	int width, height;
+	ptrdiff_t stride_x, stride_y;
+} therm_field;
+
+/* Heat injected on every step into the cells within radius of a point.
+ * Position is from 0 to 1 across the grid, radius in cells, below half a
+ * cell the single cell the point lies in, power in temperature per time. */
+typedef struct therm_source {
+	float x, y;
+	float radius;
+	float power;
+} therm_source;
+
+typedef struct therm_sim therm_sim;
+
+int therm_api_version(void);
+/* description of the last failure on this thread */
+const char *therm_error(void);
+
+void therm_config_default(therm_config *config);
+
+/* starts from the built-in initial state, returns NULL on failure */
+therm_sim *therm_create(const therm_config *config);
+void therm_destroy(therm_sim *sim);
+
+int therm_width(const therm_sim *sim);
+int therm_height(const therm_sim *sim);
+/* steps done since creation */
+long therm_steps(const therm_sim *sim);
+
+int therm_step(therm_sim *sim, int n);
+
+/* Maps the current field into memory readable by the host, a pinned
+ * buffer the GPU writes into where persistent mapping is supported.
+ * The view stays valid until the next call changing or mapping the
+ * simulation, or therm_unmap_field. */
+int therm_map_field(therm_sim *sim, therm_field *field);
+void therm_unmap_field(therm_sim *sim);
+
+/* Sets the cells of a rectangle, clipped to the grid. Negative values
+ * keep the current temperature or conductivity of the cells. */
+int therm_set_region(therm_sim *sim, int x, int y, int w, int h, float temperature, float conductivity);
+
+/* Replaces the heat sources, count 0 removes them. Only the GL backend
+ * supports sources, since API version 2. */
+int therm_set_sources(therm_sim *sim, const therm_source *sources, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef THERMRING_H
+#define THERMRING_H
+
+/* Layout of the shared-memory ring of field snapshots published with
+ * --shm <name>, mapped read-only by any number of local readers.
+ *
+ * The object /dev/shm/<name> starts with a therm_ring_header, slots of
+ * slot_size bytes follow from header_size on. Each slot is a
+ * therm_ring_slot followed by height rows of stride floats of temperature,
+ * in host byte order. Frame n, counted from 1, goes to slot (n - 1) %
+ * slot_count. The publisher never waits for readers:
+ *
+ *   slot.seq = 2n - 1            odd while the slot is being written
+ *   writes the frame
+ *   slot.seq = 2n                release
+ *   header.latest = n            release
+ *
+ * A reader takes n = latest, reads the frame of its slot in place if
+ * slot.seq == 2n, then checks that slot.seq is still 2n; otherwise the
+ * publisher lapped the ring meanwhile and the data has to be dropped.
+ * therm_ring_begin and therm_ring_valid below implement this with the
+ * GCC atomic builtins. The object is removed when the publisher exits,
+ * existing mappings stay valid. */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define THERM_RING_VERSION 1
+
+typedef struct therm_ring_header {
+	/* "THRMRING" without terminator */
+	char magic[8];
+	uint32_t version;
+	/* bytes before the first slot */
+	uint32_t header_size;
+	uint32_t slot_count;
+	/* bytes from one slot to the next, slot header included */
+	uint32_t slot_size;
+	/* largest frame a slot holds, larger grids are box averaged down */
+	uint32_t max_width, max_height;
+	/* frames published so far, the newest is complete */
+	uint64_t latest;
+} therm_ring_header;
+
+typedef struct therm_ring_slot {
+	/* 2n once frame n is complete, odd while it is being written */
+	uint64_t seq;
+	/* solver steps done at the frame */
+	uint64_t step;
+	uint32_t width, height;
+	/* floats from one row to the next */
+	uint32_t stride;
+	/* cells of the grid per frame cell along each side */
+	uint32_t factor;
+	uint8_t reserved[32];
+} therm_ring_slot;
+
+/* rows of a slot start this many bytes after it */
+#define THERM_RING_SLOT_HEADER 64
+
+static inline const therm_ring_slot *therm_ring_slot_at(const therm_ring_header *h, uint64_t n) {
+	return (const therm_ring_slot *)((const char *)h + h->header_size + (size_t)((n - 1) % h->slot_count)*h->slot_size);
+}
+static inline const float *therm_ring_data(const therm_ring_slot *s) {
+	return (const float *)((const char *)s + THERM_RING_SLOT_HEADER);
+}
+
+/* Finds the latest complete frame, returns its sequence number to be
+ * passed to therm_ring_valid, or 0 if there is none yet. */
+static inline uint64_t therm_ring_begin(const therm_ring_header *h, const therm_ring_slot **slot) {
+	for(;;) {
+		uint64_t n = __atomic_load_n(&h->latest, __ATOMIC_ACQUIRE);
+		if(n == 0)
+			return 0;
+		const therm_ring_slot *s = therm_ring_slot_at(h, n);
+		uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		if(seq == 2*n) {
+			*slot = s;
+			return seq;
+		}
+	}
+}
+/* nonzero if the frame read since therm_ring_begin was not overwritten meanwhile */
+static inline int therm_ring_valid(const therm_ring_slot *s, uint64_t seq) {
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
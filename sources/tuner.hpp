@@ -0,0 +1,290 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <exception>
+
+#include <sys/stat.h>
+
+#include <GL/glew.h>
+
+#include "opengl/framebuffer.hpp"
+
+#include "solver.hpp"
+#include "backends.hpp"
+#include "options.hpp"
+#include "exchange.hpp"
+
+/* Picks the engine and steps per frame giving the highest step rate
+ * on this machine by running each candidate for a moment; an engine
+ * given on the command line is kept and only the steps are tuned.
+ * Results are cached per GL renderer, CPU model and run settings, as tab
+ * separated lines, so only the first run on a host pays for the benchmark. */
+class Tuner {
+private:
+	/* frames must not take longer than this to keep the display fluid */
+	static constexpr double FRAME_BUDGET = 1.0/30;
+	/* time each candidate runs for */
+	static constexpr double MEASURE_TIME = 0.25;
+	static const int FIELDS = 9;
+	/* leading fields of a line holding the key */
+	static const int KEY_FIELDS = 6;
+	
+	struct Config {
+		Solver::Backend backend;
+		int cl_device;
+		int steps;
+	};
+	
+	std::string path;
+	
+	/* names of the backends in the cache, in the order of Solver::Backend */
+	static const char *backendName(Solver::Backend backend) {
+		static const char *names[] = {"gl", "opencl", "amr", "hybrid", "ooc", "parareal"};
+		return names[backend];
+	}
+	static bool parseBackend(const std::string &name, Solver::Backend &backend) {
+		for(int b = Solver::GL; b <= Solver::PARAREAL; ++b) {
+			if(name == backendName(Solver::Backend(b))) {
+				backend = Solver::Backend(b);
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	static std::string cpuModel() {
+		FILE *f = fopen("/proc/cpuinfo", "r");
+		if(f == nullptr)
+			return "unknown";
+		char line[512];
+		std::string model = "unknown";
+		while(fgets(line, sizeof(line), f) != nullptr) {
+			if(strncmp(line, "model name", 10) == 0) {
+				const char *val = strchr(line, ':');
+				if(val != nullptr) {
+					model = val + 1 + strspn(val + 1, " ");
+					model.erase(model.find_last_not_of("\r\n") + 1);
+				}
+				break;
+			}
+		}
+		fclose(f);
+		return model;
+	}
+	
+	static std::string renderer() {
+		const GLubyte *r = glGetString(GL_RENDERER);
+		return r != nullptr ? std::string(reinterpret_cast<const char *>(r)) : "unknown";
+	}
+	
+	/* everything the best configuration depends on, tab separated */
+	static std::string key(const Options &opts) {
+		char buf[64];
+		snprintf(
+		  buf, sizeof(buf), "%d\t%s\t%g\t%s", opts.size,
+		  opts.integrator == Solver::RKL2 ? "rkl2" : "euler", opts.dt,
+		  opts.backend_set ? backendName(opts.backend) : "any"
+		);
+		return renderer() + "\t" + cpuModel() + "\t" + buf;
+	}
+	
+	static std::vector<std::string> split(const std::string &line) {
+		std::vector<std::string> fields;
+		size_t pos = 0;
+		for(;;) {
+			size_t tab = line.find('\t', pos);
+			fields.push_back(line.substr(pos, tab - pos));
+			if(tab == std::string::npos)
+				break;
+			pos = tab + 1;
+		}
+		return fields;
+	}
+	
+	/* lines of the cache file but the one with the given key */
+	std::vector<std::string> readCache(const std::string &k, Config *found) const {
+		std::vector<std::string> lines;
+		FILE *f = fopen(path.c_str(), "r");
+		if(f == nullptr)
+			return lines;
+		char buf[1024];
+		while(fgets(buf, sizeof(buf), f) != nullptr) {
+			std::string line(buf);
+			line.erase(line.find_last_not_of("\r\n") + 1);
+			std::vector<std::string> fields = split(line);
+			if(fields.size() != FIELDS)
+				continue;
+			std::string line_key = fields[0];
+			for(int i = 1; i < KEY_FIELDS; ++i) {
+				line_key += "\t" + fields[i];
+			}
+			if(line_key == k) {
+				/* a line naming no known backend is dropped and measured again */
+				Solver::Backend backend;
+				if(found != nullptr && parseBackend(fields[KEY_FIELDS], backend)) {
+					found->backend = backend;
+					found->cl_device = atoi(fields[KEY_FIELDS + 1].c_str());
+					found->steps = atoi(fields[KEY_FIELDS + 2].c_str());
+				}
+				continue;
+			}
+			lines.push_back(line);
+		}
+		fclose(f);
+		return lines;
+	}
+	
+	void writeCache(const std::string &k, const Config &c) const {
+		std::vector<std::string> lines = readCache(k, nullptr);
+		char buf[64];
+		snprintf(buf, sizeof(buf), "\t%s\t%d\t%d", backendName(c.backend), c.cl_device, c.steps);
+		lines.push_back(k + buf);
+		
+		/* existing directories make mkdir fail, which is fine */
+		for(size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+			mkdir(path.substr(0, slash).c_str(), 0755);
+		}
+		std::string tmp = path + ".tmp";
+		FILE *f = fopen(tmp.c_str(), "w");
+		if(f == nullptr) {
+			perror("error write tuning cache");
+			return;
+		}
+		for(const std::string &line : lines) {
+			fprintf(f, "%s\n", line.c_str());
+		}
+		fclose(f);
+		if(rename(tmp.c_str(), path.c_str()) != 0)
+			perror("error write tuning cache");
+	}
+	
+	/* steps per second of a candidate, frame time is returned in frame */
+	static double measure(const Options &opts, double &frame) {
+		std::unique_ptr<Solver> solver = createSolver(opts);
+		gl::FrameBuffer target;
+		/* frames as large as the worker sends them */
+		target.setSize(
+		  std::min(solver->width(), int(FrameExchange::MAX_FRAME)),
+		  std::min(solver->height(), int(FrameExchange::MAX_FRAME))
+		);
+		
+		/* first frame compiles kernels and warms caches, not counted */
+		solver->step(opts.steps);
+		solver->copy(&target);
+		glFinish();
+		
+		auto start = std::chrono::steady_clock::now();
+		double elapsed = 0.0;
+		int frames = 0;
+		while(elapsed < MEASURE_TIME || frames < 2) {
+			solver->step(opts.steps);
+			solver->copy(&target);
+			glFinish();
+			frames += 1;
+			elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		frame = elapsed/frames;
+		return double(frames)*opts.steps/elapsed;
+	}
+	
+	static std::vector<Config> candidates(const Options &opts) {
+		std::vector<int> steps;
+		if(opts.integrator == Solver::RKL2)
+			steps = {1, 2, 4, 8};
+		else
+			steps = {16, 32, 64, 128, 256, 512};
+		std::vector<Config> list;
+		if(opts.backend_set) {
+			for(int n : steps) {
+				list.push_back(Config{opts.backend, opts.cl_device, n});
+			}
+			return list;
+		}
+		for(int n : steps) {
+			list.push_back(Config{Solver::GL, 0, n});
+		}
+#ifdef THERM_OPENCL
+		int devices = CLSolver::deviceCount();
+		for(int d = 0; d < devices; ++d) {
+			for(int n : steps) {
+				list.push_back(Config{Solver::OPENCL, d, n});
+			}
+		}
+#endif
+		return list;
+	}
+	
+	static void apply(const Config &c, Options &opts) {
+		opts.backend = c.backend;
+		opts.cl_device = c.cl_device;
+		opts.steps = c.steps;
+	}
+
+public:
+	/* empty path selects the default under $XDG_CACHE_HOME or ~/.cache */
+	Tuner(const std::string &cache_path) : path(cache_path) {
+		if(path.empty()) {
+			const char *xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+			if(xdg != nullptr && xdg[0] != '\0')
+				path = std::string(xdg) + "/therm/tune.txt";
+			else if(home != nullptr)
+				path = std::string(home) + "/.cache/therm/tune.txt";
+			else
+				path = "therm-tune.txt";
+		}
+	}
+	
+	/* sets backend, device and steps of opts to the best found, or only
+	 * the steps if the backend was given, must be called with a GL context current */
+	void tune(Options &opts, bool force) {
+		std::string k = key(opts);
+		Config best = {Solver::GL, 0, 0};
+		if(!force) {
+			readCache(k, &best);
+			if(best.steps > 0) {
+				apply(best, opts);
+				return;
+			}
+		}
+		
+		double best_rate = 0.0, best_frame = 0.0;
+		bool found = false;
+		for(const Config &c : candidates(opts)) {
+			Options trial = opts;
+			apply(c, trial);
+			double rate, frame;
+			try {
+				rate = measure(trial, frame);
+			} catch(const std::exception &e) {
+				fprintf(stderr, "Tuning: skipped %s: %s\n", backendName(c.backend), e.what());
+				continue;
+			}
+			fprintf(
+			  stderr, "Tuning: %s device %d, %d steps per frame: %.0f steps/s, %.1f ms per frame\n",
+			  backendName(c.backend), c.cl_device, c.steps, rate, 1e3*frame
+			);
+			/* within the frame budget the rate decides, otherwise the frame time */
+			bool better = !found ||
+			  (frame <= FRAME_BUDGET && (best_frame > FRAME_BUDGET || rate > best_rate)) ||
+			  (frame > FRAME_BUDGET && best_frame > FRAME_BUDGET && frame < best_frame);
+			if(better) {
+				best = c;
+				best_rate = rate;
+				best_frame = frame;
+				found = true;
+			}
+		}
+		if(!found)
+			return;
+		apply(best, opts);
+		writeCache(k, best);
+	}
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cmath>
+
+#include <algorithm>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "opengl/program.hpp"
+#include "opengl/framebuffer.hpp"
+#include "opengl/sampler.hpp"
+
+#include "programs.hpp"
+#include "solver.hpp"
+
+/* Renders the visible part of the field into a display frame. Zoomed
+ * out views sample a pyramid of box averaged levels instead of the field
+ * itself, so a frame costs its own size whatever the grid size is and
+ * large fields do not alias. The pyramid is rebuilt every few frames only,
+ * views fine enough for the full resolution sample the field directly, or
+ * its copy, which is refreshed every frame. */
+class Viewer {
+private:
+	/* frames between pyramid rebuilds */
+	static const int REBUILD = 4;
+	/* base level size for backends without a field texture */
+	static const int BASE_MAX = 4096;
+	
+	Programs programs;
+	gl::VertexBuffer buf;
+	gl::Sampler linear{gl::Texture::LINEAR};
+	gl::Sampler nearest{gl::Texture::NEAREST};
+	/* levels[0] is the copy of the field if the solver has no texture,
+	 * each next level halves the one before */
+	std::vector<gl::FrameBuffer> levels;
+	int base_w = 0, base_h = 0;
+	int frames = 0;
+	
+	/* center of the view in field coordinates from 0 to 1, zoom 1 shows it all */
+	float cx = 0.5f, cy = 0.5f, zoom = 1.0f;
+	
+	const gl::Texture *base(const Solver &solver) const {
+		const gl::Texture *tex = solver.getTexture();
+		return tex != nullptr ? tex : levels[0].getTexture();
+	}
+	
+	void rebuild(Solver &solver) {
+		const gl::Texture *tex = solver.getTexture();
+		int w = std::min(solver.width(), BASE_MAX), h = std::min(solver.height(), BASE_MAX);
+		if(tex != nullptr) {
+			w = tex->width();
+			h = tex->height();
+		}
+		
+		/* levels follow the size of the base, level 0 only exists without a field texture */
+		if(levels.empty() || w != base_w || h != base_h || (tex == nullptr) != (levels[0].width() > 0)) {
+			base_w = w;
+			base_h = h;
+			levels.clear();
+			levels.resize(1);
+			if(tex == nullptr)
+				levels[0].setSize(w, h);
+			while(w > 1 || h > 1) {
+				w = (w + 1)/2;
+				h = (h + 1)/2;
+				levels.push_back(gl::FrameBuffer());
+				levels.back().setSize(w, h);
+			}
+		}
+		if(tex == nullptr)
+			solver.copy(&levels[0]);
+		
+		gl::Program *prog = programs["downsample"];
+		int factor[] = {2, 2};
+		prog->setUniform("u_factor", factor, 2);
+		prog->setUniform("u_mode", int(Solver::BOX));
+		const gl::Texture *src = base(solver);
+		for(size_t i = 1; i < levels.size(); ++i) {
+			int area_size[] = {src->width(), src->height()};
+			int target_size[] = {levels[i].width(), levels[i].height()};
+			prog->setUniform("u_source", src, &nearest);
+			prog->setUniform("u_area_size", area_size, 2);
+			prog->setUniform("u_target_size", target_size, 2);
+			levels[i].bind();
+			prog->evaluate();
+			src = levels[i].getTexture();
+		}
+		gl::FrameBuffer::unbind();
+	}
+
+public:
+	Viewer() : programs({
+		  Programs::ShaderInfo("position",  "position.vert",   gl::Shader::VERTEX),
+		  Programs::ShaderInfo("view",      "view.frag",       gl::Shader::FRAGMENT),
+		  Programs::ShaderInfo("downsample", "downsample.frag", gl::Shader::FRAGMENT)
+		}, {
+		  Programs::ProgramInfo("view",      "position", "view"),
+		  Programs::ProgramInfo("downsample", "position", "downsample")
+		})
+	{
+		float vertex_data[] = {
+		  0, 0, 1, 0, 0, 1,
+		  0, 1, 1, 0, 1, 1
+		};
+		buf.loadData(vertex_data, 12);
+		
+		float map_data[]    = {2, 0, 0, 2};
+		float offset_data[] = {-1, -1};
+		
+		for(const char *name : {"view", "downsample"}) {
+			programs[name]->setAttribute("a_vertex", &buf);
+			programs[name]->setUniform("u_map", map_data, 4);
+			programs[name]->setUniform("u_offset", offset_data, 2);
+		}
+	}
+	
+	void setView(float x, float y, float z) {
+		cx = x;
+		cy = y;
+		zoom = z;
+	}
+	
+	void render(Solver &solver, gl::FrameBuffer *dst) {
+		if(levels.empty() || frames >= REBUILD) {
+			rebuild(solver);
+			frames = 0;
+		} else if(solver.getTexture() == nullptr && levels[0].width() > 0) {
+			solver.copy(&levels[0]);
+		}
+		frames += 1;
+		
+		/* the coarsest level with at least a texel per pixel */
+		const gl::Texture *tex = base(solver);
+		float texels = std::max(float(tex->width())/dst->width(), float(tex->height())/dst->height())/zoom;
+		int level = texels > 1.0f ? int(std::log2(texels)) : 0;
+		level = std::min(level, int(levels.size()) - 1);
+		float su = 1.0f, sv = 1.0f;
+		if(level > 0) {
+			/* levels of odd size cover a bit more than the base */
+			su = float(tex->width())/(levels[level].width() << level);
+			sv = float(tex->height())/(levels[level].height() << level);
+			tex = levels[level].getTexture();
+		}
+		float extent = 1.0f/zoom;
+		float rect[] = {su*(cx - 0.5f*extent), sv*(cy - 0.5f*extent), su*extent, sv*extent};
+		dst->bind();
+		programs["view"]->setUniform("u_texture", tex, &linear);
+		programs["view"]->setUniform("u_rect", rect, 4);
+		programs["view"]->evaluate();
+		gl::FrameBuffer::unbind();
+	}
+};
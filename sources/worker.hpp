@@ -0,0 +1,272 @@
+#pragma once
+
+#include <cstdio>
+
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <deque>
+#include <exception>
+
+#include <SDL2/SDL.h>
+
+#include "solver.hpp"
+#include "backends.hpp"
+#include "options.hpp"
+#include "exchange.hpp"
+#include "queue.hpp"
+#include "recorder.hpp"
+#include "metrics.hpp"
+#include "publisher.hpp"
+#include "probelog.hpp"
+#include "viewer.hpp"
+
+/* Runs the solver on its own thread and GL context, so the simulation
+ * is neither throttled by the display swap nor by the event handling. */
+class Worker {
+public:
+	struct Command {
+		enum Kind {
+			QUIT,
+			PAUSE,
+			STEP,
+			SET_STEPS,
+			/* value is the new grid size */
+			RESIZE,
+			/* x, y and zoom give the visible part of the field */
+			VIEW
+		};
+		Kind kind;
+		int value;
+		float x, y, zoom;
+		Command() = default;
+		Command(Kind k, int v = 0) : kind(k), value(v), x(0.5f), y(0.5f), zoom(1.0f) {}
+		Command(Kind k, float vx, float vy, float vz) : kind(k), value(0), x(vx), y(vy), zoom(vz) {}
+	};
+
+private:
+	SDL_Window *window;
+	SDL_GLContext context;
+	Options opts;
+	FrameExchange *exchange;
+	Queue<Command, 64> commands;
+	std::thread thread;
+	std::atomic<bool> running{true};
+	/* cells along a side of the running grid, 0 before it is created */
+	std::atomic<int> grid{0};
+	
+	bool done = false;
+	bool paused = false;
+	int pending = 0;
+	int steps;
+	int resize = 0;
+	/* visible part of the field, changed since the last frame */
+	float view_x = 0.5f, view_y = 0.5f, view_zoom = 1.0f;
+	bool view_changed = false;
+	/* steps done since start */
+	long total = 0;
+	std::chrono::steady_clock::time_point start;
+	/* steps and times of stats requested but not received yet */
+	std::deque<std::pair<long, double>> stats_requests;
+	
+	double seconds() const {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	
+	/* writes the probe samples that have arrived, all of them if wait */
+	void logProbes(Solver &solver, ProbeLog *probes, bool wait = false) {
+		long step;
+		std::vector<float> values;
+		while(solver.pollProbes(step, values, wait)) {
+			probes->write(step, values);
+		}
+	}
+	
+	/* steps n times, stopping exactly at the steps to be recorded, measured, published or probed */
+	void advance(Solver &solver, int n, Recorder *recorder, Metrics *metrics, Publisher *publisher, ProbeLog *probes) {
+		while(n > 0) {
+			long m = n;
+			if(recorder != nullptr)
+				m = std::min(m, opts.record_every - total % opts.record_every);
+			if(metrics != nullptr)
+				m = std::min(m, opts.metrics_every - total % opts.metrics_every);
+			if(publisher != nullptr)
+				m = std::min(m, opts.shm_every - total % opts.shm_every);
+			if(probes != nullptr)
+				m = std::min(m, opts.probe_every - total % opts.probe_every);
+			solver.step(m);
+			total += m;
+			n -= m;
+			if(recorder != nullptr && total % opts.record_every == 0) {
+				Field2D frame;
+				solver.readField(frame);
+				recorder->record(total, std::move(frame));
+			}
+			if(metrics != nullptr && total % opts.metrics_every == 0) {
+				if(solver.requestStats(total))
+					stats_requests.push_back(std::make_pair(total, seconds()));
+			}
+			if(publisher != nullptr && total % opts.shm_every == 0)
+				publisher->publish(solver, total);
+			if(probes != nullptr && total % opts.probe_every == 0)
+				solver.sampleProbes(total);
+		}
+		if(probes != nullptr)
+			logProbes(solver, probes);
+		if(metrics != nullptr) {
+			long tag;
+			Solver::Stats st;
+			while(solver.pollStats(tag, st)) {
+				while(!stats_requests.empty() && stats_requests.front().first != tag)
+					stats_requests.pop_front();
+				if(stats_requests.empty())
+					break;
+				metrics->publish(tag, stats_requests.front().second, st.sum, st.min, st.max);
+				stats_requests.pop_front();
+			}
+		}
+	}
+	
+	void handle(const Command &cmd) {
+		switch(cmd.kind) {
+		case Command::QUIT:
+			done = true;
+			break;
+		case Command::PAUSE:
+			paused = cmd.value != 0;
+			break;
+		case Command::STEP:
+			pending += 1;
+			break;
+		case Command::SET_STEPS:
+			steps = cmd.value > 0 ? cmd.value : 1;
+			break;
+		case Command::RESIZE:
+			resize = cmd.value;
+			break;
+		case Command::VIEW:
+			view_x = cmd.x;
+			view_y = cmd.y;
+			view_zoom = cmd.zoom;
+			view_changed = true;
+			break;
+		}
+	}
+	
+	void run() {
+		SDL_GL_MakeCurrent(window, context);
+		try {
+			std::unique_ptr<Solver> solver_ptr = createSolver(opts);
+			Solver &solver = *solver_ptr;
+			grid = solver.width();
+			Viewer view;
+			exchange->create(
+			  std::min(solver.width(), int(FrameExchange::MAX_FRAME)),
+			  std::min(solver.height(), int(FrameExchange::MAX_FRAME))
+			);
+			std::unique_ptr<Recorder> recorder;
+			if(!opts.record_file.empty()) {
+				recorder.reset(new Recorder(
+				  opts.record_file, solver.width(), solver.height(), opts.record_error,
+				  opts.record_key, opts.record_threads, opts.record_queue
+				));
+			}
+			std::unique_ptr<Metrics> metrics;
+			if(!opts.metrics_file.empty() || !opts.metrics_prom.empty())
+				metrics.reset(new Metrics(opts.metrics_file, opts.metrics_prom, opts.metrics_rotate));
+			std::unique_ptr<Publisher> publisher;
+			if(!opts.shm_name.empty()) {
+				publisher.reset(new Publisher(
+				  opts.shm_name, opts.shm_slots,
+				  std::min(solver.width(), int(FrameExchange::MAX_FRAME)), std::min(solver.height(), int(FrameExchange::MAX_FRAME))
+				));
+			}
+			std::unique_ptr<ProbeLog> probes;
+			if(!opts.probes_file.empty()) {
+				probes.reset(new ProbeLog(opts.probes_file, opts.probe_out));
+				solver.setProbes(probes->probes());
+				if(probes->probes().empty())
+					probes.reset();
+			}
+			start = std::chrono::steady_clock::now();
+			
+			while(!done) {
+				Command cmd;
+				while(commands.pop(cmd)) {
+					handle(cmd);
+				}
+				if(view_changed)
+					view.setView(view_x, view_y, view_zoom);
+				if(resize > 0) {
+					if(recorder)
+						fprintf(stderr, "Grid size is fixed while recording\n");
+					else
+						solver.resize(resize, resize);
+					resize = 0;
+					grid = solver.width();
+				}
+				if(paused && pending <= 0) {
+					/* panning and zooming go on while paused */
+					if(view_changed) {
+						view.render(solver, exchange->acquireBack());
+						exchange->publishBack();
+						view_changed = false;
+					}
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					continue;
+				}
+				if(pending > 0)
+					pending -= 1;
+				
+				advance(solver, steps, recorder.get(), metrics.get(), publisher.get(), probes.get());
+				view.render(solver, exchange->acquireBack());
+				exchange->publishBack();
+				view_changed = false;
+			}
+			
+			if(probes) {
+				solver.flushProbes();
+				logProbes(solver, probes.get(), true);
+			}
+			solver.writeFile(opts.out_file, opts.out_factor, opts.out_mode);
+			exchange->destroy();
+		} catch(const std::exception &e) {
+			fprintf(stderr, "Simulation stopped: %s\n", e.what());
+		}
+		SDL_GL_MakeCurrent(window, nullptr);
+		running = false;
+	}
+
+public:
+	/* ctx must share objects with the context displaying the exchange frames */
+	Worker(SDL_Window *win, SDL_GLContext ctx, FrameExchange *ex, const Options &o)
+	  : window(win), context(ctx), opts(o), exchange(ex), steps(o.steps)
+	{
+		thread = std::thread(&Worker::run, this);
+	}
+	~Worker() {
+		stop();
+	}
+	
+	/* grid size the solver runs at, which a resize may have left unchanged */
+	int gridSize() const {
+		return grid;
+	}
+	
+	/* returns false if the queue is full and the command was dropped */
+	bool send(const Command &cmd) {
+		return commands.push(cmd);
+	}
+	
+	void stop() {
+		if(thread.joinable()) {
+			while(running && !send(Command(Command::QUIT))) {
+				std::this_thread::yield();
+			}
+			thread.join();
+		}
+	}
+};
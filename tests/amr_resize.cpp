@@ -0,0 +1,86 @@
+#include <cstdio>
+
+#include <SDL2/SDL.h>
+#include <GL/glew.h>
+
+#include "amrsolver.hpp"
+
+/* A fixed hot square keeps its place when the AMR grid shrinks and the
+ * blocks refined below the new level cap are merged from the source. */
+
+/* exit code ctest reports as skipped, no GL context to run the solver */
+static const int SKIP = 77;
+
+static const int OLD_SIZE = 256, NEW_SIZE = 128;
+/* hot square in fractions of the grid side */
+static const double LO = 0.375, HI = 0.5;
+
+static bool hot(double u, double v) {
+	return u >= LO && u < HI && v >= LO && v < HI;
+}
+
+static int check() {
+	Field2D state(2, OLD_SIZE, OLD_SIZE);
+	for(int iy = 0; iy < OLD_SIZE; ++iy) {
+		float *t = state.row(Solver::TEMP, iy), *k = state.row(Solver::COND, iy);
+		for(int ix = 0; ix < OLD_SIZE; ++ix) {
+			bool h = hot(double(ix)/OLD_SIZE, double(iy)/OLD_SIZE);
+			t[ix] = h ? 1.0f : 0.0f;
+			k[ix] = h ? 0.0f : 1.0f;
+		}
+	}
+	AMRSolver solver(Solver::EULER, 0.1, 0.02f, 16);
+	solver.init(state);
+	solver.resize(NEW_SIZE, NEW_SIZE);
+	
+	Field2D out;
+	solver.readState(out);
+	if(out.width() != NEW_SIZE || out.height() != NEW_SIZE) {
+		fprintf(stderr, "grid is %dx%d after resizing to %d\n", out.width(), out.height(), NEW_SIZE);
+		return 1;
+	}
+	int errors = 0;
+	for(int iy = 0; iy < NEW_SIZE; ++iy) {
+		for(int ix = 0; ix < NEW_SIZE; ++ix) {
+			bool h = hot(double(ix)/NEW_SIZE, double(iy)/NEW_SIZE);
+			bool fixed = out.at(Solver::COND, ix, iy) <= 0.0f;
+			if(fixed != h || (h && out.at(Solver::TEMP, ix, iy) != 1.0f)) {
+				if(errors < 8)
+					fprintf(stderr, "cell %d %d: temperature %g, conductivity %g\n", ix, iy, out.at(Solver::TEMP, ix, iy), out.at(Solver::COND, ix, iy));
+				errors += 1;
+			}
+		}
+	}
+	if(errors > 0) {
+		fprintf(stderr, "%d cells of the hot square moved\n", errors);
+		return 1;
+	}
+	return 0;
+}
+
+int main() {
+	if(SDL_Init(SDL_INIT_VIDEO) != 0) {
+		fprintf(stderr, "Could not init SDL video: %s\n", SDL_GetError());
+		return SKIP;
+	}
+	SDL_Window *window = SDL_CreateWindow("test", 0, 0, 1, 1, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	SDL_GLContext context = window != nullptr ? SDL_GL_CreateContext(window) : nullptr;
+	if(context == nullptr || glewInit() != GLEW_OK) {
+		fprintf(stderr, "Could not create a GL context\n");
+		if(window != nullptr)
+			SDL_DestroyWindow(window);
+		SDL_Quit();
+		return SKIP;
+	}
+	int result;
+	try {
+		result = check();
+	} catch(const std::exception &e) {
+		fprintf(stderr, "%s\n", e.what());
+		result = 1;
+	}
+	SDL_GL_DeleteContext(context);
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+	return result;
+}